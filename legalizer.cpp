@@ -9,6 +9,24 @@
 #include <numeric>
 #include <cctype>
 #include <iomanip> // 
+#include <functional>
+#include <queue>
+#include <memory>
+#include <cstdio>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 using namespace std;
 
@@ -20,6 +38,401 @@ inline string trim(const string& s) {
     return s.substr(start, end - start + 1);
 }
 
+//壓縮格式
+enum class Compression {
+    None,
+    Gzip,    //需以 -DUSE_ZLIB 編譯並連結 -lz
+    Zstd     //需以 -DUSE_ZSTD 編譯並連結 -lzstd
+};
+
+//壓縮格式對應的副檔名
+inline string compressionSuffix(Compression compression) {
+    switch (compression) {
+    case Compression::Gzip: return ".gz";
+    case Compression::Zstd: return ".zst";
+    default: return "";
+    }
+}
+
+//依檔頭判斷壓縮格式
+inline Compression detectCompression(const string& filename) {
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) return Compression::None;
+    size_t n = fread(magic, 1, 4, file);
+    fclose(file);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::Gzip;
+    if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::Zstd;
+    return Compression::None;
+}
+
+#ifdef USE_ZLIB
+//gzip 解壓縮輸入緩衝
+class GzipInStreamBuf : public streambuf {
+public:
+    explicit GzipInStreamBuf(const string& filename) : buffer(1 << 18) {
+        file = gzopen(filename.c_str(), "rb");
+        if (file) gzbuffer(file, 1 << 18);
+    }
+    ~GzipInStreamBuf() override {
+        if (file) gzclose(file);
+    }
+    bool isOpen() const { return file != nullptr; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        int n = gzread(file, buffer.data(), static_cast<unsigned>(buffer.size()));
+        if (n <= 0) {
+            //截斷的檔案會回報 Z_BUF_ERROR，不能當成正常的檔案結尾
+            int err = Z_OK;
+            const char* message = gzerror(file, &err);
+            if (n < 0 || err != Z_OK) {
+                cerr << "錯誤：gzip 解壓縮失敗：" << message << endl;
+                exit(1);
+            }
+            return traits_type::eof();
+        }
+        setg(buffer.data(), buffer.data(), buffer.data() + n);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    gzFile file;
+    vector<char> buffer;
+};
+#endif
+
+#ifdef USE_ZSTD
+//zstd 解壓縮輸入緩衝
+class ZstdInStreamBuf : public streambuf {
+public:
+    explicit ZstdInStreamBuf(const string& filename)
+        : filename(filename), file(fopen(filename.c_str(), "rb")), stream(ZSTD_createDStream()),
+        inBuffer(ZSTD_DStreamInSize()), outBuffer(ZSTD_DStreamOutSize()), input{ nullptr, 0, 0 },
+        lastResult(1), atEnd(false) {
+        ZSTD_initDStream(stream);
+        input.src = inBuffer.data();
+    }
+    ~ZstdInStreamBuf() override {
+        if (file) fclose(file);
+        ZSTD_freeDStream(stream);
+    }
+    bool isOpen() const { return file != nullptr; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        for (;;) {
+            if (input.pos == input.size && !atEnd) {
+                input.size = fread(inBuffer.data(), 1, inBuffer.size(), file);
+                input.pos = 0;
+                if (ferror(file)) {
+                    cerr << "錯誤：讀取 " << filename << " 失敗" << endl;
+                    exit(1);
+                }
+                atEnd = input.size == 0;
+            }
+            //只有最後一次解壓縮回傳 0(框架完整結束)時，輸入結尾才是正常的檔案結尾
+            if (atEnd && lastResult == 0) return traits_type::eof();
+            ZSTD_outBuffer output = { outBuffer.data(), outBuffer.size(), 0 };
+            size_t ret = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(ret)) {
+                cerr << "錯誤：zstd 解壓縮失敗（" << filename << "）：" << ZSTD_getErrorName(ret) << endl;
+                exit(1);
+            }
+            lastResult = ret;
+            if (output.pos > 0) {
+                setg(outBuffer.data(), outBuffer.data(), outBuffer.data() + output.pos);
+                return traits_type::to_int_type(*gptr());
+            }
+            if (atEnd) {
+                cerr << "錯誤：zstd 解壓縮失敗（" << filename << "）：檔案不完整" << endl;
+                exit(1);
+            }
+        }
+    }
+
+private:
+    string filename;
+    FILE* file;
+    ZSTD_DStream* stream;
+    vector<char> inBuffer;
+    vector<char> outBuffer;
+    ZSTD_inBuffer input;
+    size_t lastResult;    //最後一次 ZSTD_decompressStream 的回傳值
+    bool atEnd;           //輸入檔已讀完
+};
+#endif
+
+//輸入檔案：依檔頭自動偵測 gzip/zstd 並以串流方式解壓縮
+//指定的檔案不存在時，會嘗試加上 .gz 或 .zst 的檔案
+class InputFile : public istream {
+public:
+    explicit InputFile(const string& filename) : istream(nullptr) {
+        string path = filename;
+        for (const char* suffix : { "", ".gz", ".zst" }) {
+            FILE* probe = fopen((filename + suffix).c_str(), "rb");
+            if (probe) {
+                fclose(probe);
+                path = filename + suffix;
+                break;
+            }
+        }
+        bool opened = false;
+        switch (detectCompression(path)) {
+        case Compression::Gzip: {
+#ifdef USE_ZLIB
+            auto gz = new GzipInStreamBuf(path);
+            buf.reset(gz);
+            opened = gz->isOpen();
+#else
+            cerr << "錯誤：" << path << " 為 gzip 壓縮檔，請以 -DUSE_ZLIB -lz 重新編譯。" << endl;
+#endif
+            break;
+        }
+        case Compression::Zstd: {
+#ifdef USE_ZSTD
+            auto zst = new ZstdInStreamBuf(path);
+            buf.reset(zst);
+            opened = zst->isOpen();
+#else
+            cerr << "錯誤：" << path << " 為 zstd 壓縮檔，請以 -DUSE_ZSTD -lzstd 重新編譯。" << endl;
+#endif
+            break;
+        }
+        default: {
+            auto plain = new filebuf();
+            buf.reset(plain);
+            opened = plain->open(path, ios::in | ios::binary) != nullptr;
+            break;
+        }
+        }
+        rdbuf(buf.get());
+        if (!opened) setstate(ios::failbit);
+    }
+
+private:
+    unique_ptr<streambuf> buf;
+};
+
+//背景壓縮輸出緩衝：格式化在呼叫端執行緒進行，壓縮與寫檔交給背景執行緒
+//背景執行緒遇到寫入錯誤時只記錄旗標，由 close() 回報給呼叫端
+class CompressingStreamBuf : public streambuf {
+public:
+    CompressingStreamBuf(const string& filename, Compression compression)
+        : compression(compression), buffer(1 << 20), done(false), opened(false), closed(false), failed(false) {
+#ifdef USE_ZLIB
+        gz = nullptr;
+        if (compression == Compression::Gzip) {
+            gz = gzopen(filename.c_str(), "wb6");
+            opened = gz != nullptr;
+        }
+#endif
+#ifdef USE_ZSTD
+        file = nullptr;
+        stream = nullptr;
+        if (compression == Compression::Zstd) {
+            file = fopen(filename.c_str(), "wb");
+            stream = ZSTD_createCStream();
+            ZSTD_initCStream(stream, 3);
+            outBuffer.resize(ZSTD_CStreamOutSize());
+            opened = file != nullptr;
+        }
+#endif
+        (void)filename;
+        setp(buffer.data(), buffer.data() + buffer.size());
+        if (opened) {
+            worker = thread(&CompressingStreamBuf::run, this);
+        }
+    }
+    ~CompressingStreamBuf() override {
+        close();
+    }
+    bool isOpen() const { return opened; }
+
+    //送出剩餘資料並等待背景執行緒寫完，全部寫入成功時回傳 true
+    bool close() {
+        if (!opened) return false;
+        if (!closed) {
+            closed = true;
+            submit();
+            {
+                lock_guard<mutex> lock(queueMutex);
+                done = true;
+            }
+            queueReady.notify_all();
+            worker.join();
+        }
+        return !failed;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        submit();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+    int sync() override {
+        submit();
+        return 0;
+    }
+
+private:
+    //將目前緩衝交給背景執行緒，佇列已滿時等待以限制記憶體用量
+    void submit() {
+        if (!opened || pptr() == pbase()) return;
+        if (failed) { // 已失敗時丟棄後續資料，不再排入佇列
+            setp(buffer.data(), buffer.data() + buffer.size());
+            return;
+        }
+        vector<char> chunk(pbase(), pptr());
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueSpace.wait(lock, [&] { return chunks.size() < 4; });
+            chunks.push_back(move(chunk));
+        }
+        queueReady.notify_one();
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    void run() {
+        for (;;) {
+            vector<char> chunk;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [&] { return done || !chunks.empty(); });
+                if (chunks.empty()) break;
+                chunk = move(chunks.front());
+                chunks.pop_front();
+            }
+            queueSpace.notify_one();
+            if (!failed && !write(chunk)) {
+                failed = true;
+            }
+        }
+        if (!finish()) {
+            failed = true;
+        }
+    }
+
+    //壓縮並寫出一個區塊，任何一步失敗即回傳 false
+    bool write(const vector<char>& chunk) {
+#ifdef USE_ZLIB
+        if (compression == Compression::Gzip) {
+            if (chunk.empty()) return true;
+            return gzwrite(gz, chunk.data(), static_cast<unsigned>(chunk.size())) == static_cast<int>(chunk.size());
+        }
+#endif
+#ifdef USE_ZSTD
+        if (compression == Compression::Zstd) {
+            ZSTD_inBuffer input = { chunk.data(), chunk.size(), 0 };
+            while (input.pos < input.size) {
+                ZSTD_outBuffer output = { outBuffer.data(), outBuffer.size(), 0 };
+                size_t ret = ZSTD_compressStream(stream, &output, &input);
+                if (ZSTD_isError(ret)) return false; // 否則 input.pos 不再前進
+                if (fwrite(outBuffer.data(), 1, output.pos, file) != output.pos) return false;
+            }
+            return true;
+        }
+#endif
+        (void)chunk;
+        return true;
+    }
+
+    //結束壓縮串流並關閉檔案，即使先前已失敗也會釋放資源
+    bool finish() {
+        bool ok = !failed;
+#ifdef USE_ZLIB
+        if (gz && gzclose(gz) != Z_OK) ok = false;
+#endif
+#ifdef USE_ZSTD
+        if (stream) {
+            size_t remaining = 0;
+            while (ok) {
+                ZSTD_outBuffer output = { outBuffer.data(), outBuffer.size(), 0 };
+                remaining = ZSTD_endStream(stream, &output);
+                if (ZSTD_isError(remaining) || fwrite(outBuffer.data(), 1, output.pos, file) != output.pos) {
+                    ok = false;
+                }
+                if (remaining == 0) break;
+            }
+            ZSTD_freeCStream(stream);
+        }
+        if (file && fclose(file) != 0) ok = false;
+#endif
+        return ok;
+    }
+
+    Compression compression;
+    vector<char> buffer;
+    deque<vector<char>> chunks;
+    mutex queueMutex;
+    condition_variable queueReady;
+    condition_variable queueSpace;
+    bool done;
+    bool opened;
+    bool closed;
+    atomic<bool> failed;     //背景執行緒寫入失敗
+    thread worker;
+#ifdef USE_ZLIB
+    gzFile gz;
+#endif
+#ifdef USE_ZSTD
+    FILE* file;
+    ZSTD_CStream* stream;
+    vector<char> outBuffer;
+#endif
+};
+
+//輸出檔案：可選擇在背景執行緒壓縮
+class OutputFile : public ostream {
+public:
+    explicit OutputFile(const string& filename, Compression compression = Compression::None)
+        : ostream(nullptr), plain(nullptr), compressing(nullptr) {
+        bool opened;
+        if (compression == Compression::None) {
+            plain = new filebuf();
+            buf.reset(plain);
+            opened = plain->open(filename, ios::out | ios::binary | ios::trunc) != nullptr;
+        }
+        else {
+            compressing = new CompressingStreamBuf(filename, compression);
+            buf.reset(compressing);
+            opened = compressing->isOpen();
+        }
+        rdbuf(buf.get());
+        if (!opened) setstate(ios::failbit);
+    }
+    ~OutputFile() override {
+        if (buf) close();
+    }
+
+    //寫出全部資料並關閉檔案，包含背景壓縮在內全部成功時回傳 true
+    bool close() {
+        if (!buf) return false;
+        flush();
+        bool ok = !bad(); // 寫入錯誤會設定 badbit(空來源的 << 只設定 failbit，不算錯誤)
+        if (plain) {
+            ok = plain->close() != nullptr && ok;
+        }
+        else {
+            ok = compressing->close() && ok;
+        }
+        rdbuf(nullptr);
+        buf.reset();
+        return ok;
+    }
+
+private:
+    unique_ptr<streambuf> buf;
+    filebuf* plain;                     //未壓縮時的緩衝
+    CompressingStreamBuf* compressing;  //壓縮時的緩衝
+};
+
 //節點結構
 struct Node {           
     string name;         //名稱
@@ -38,20 +451,293 @@ struct Position {
     double y; //Y座標
 };
 
-//模組結構
+//定點站點座標：X與Y都以基準站點寬度的 1/2^32 為單位，載入時換算一次，之後的搜尋與比較只用整數
+const int siteShift = 32;
+const long long siteUnit = 1LL << siteShift;      //一個基準站點的定點單位數
+const double maxSiteCoordinate = 268435456.0;     //座標上限(2^28 個站點)，兩個位移相加也不會溢位
+
+//原始單位換算為定點站點單位，超出範圍時結束程式
+inline long long toSiteUnits(double value, double siteWidth) {
+    double sites = value / siteWidth;
+    if (!(fabs(sites) < maxSiteCoordinate)) {
+        cerr << "錯誤：座標 " << value << " 超出整數站點座標的範圍" << endl;
+        exit(1);
+    }
+    return llround(sites * siteUnit);
+}
+
+//定點站點單位換算回原始單位(只在輸出與報告時使用)
+inline double fromSiteUnits(long long value, double siteWidth) {
+    return static_cast<double>(value) / siteUnit * siteWidth;
+}
+
+//向下與向上取整的整數除法(b > 0)
+inline long long floorDiv(long long a, long long b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+inline long long ceilDiv(long long a, long long b) {
+    return a >= 0 ? (a + b - 1) / b : -((-a) / b);
+}
+
+//模組結構：座標與尺寸在載入時換算為定點站點單位、站點數與行高等級，不保留原始實數
 struct Block {     
     string name;        //模組名稱
-    double width;       //模組寬度
-    double height;      //模組高度
-    double x;           //當前X座標
-    double y;           //當前Y座標
-    double origX;       //原始X座標
-    double origY;       //原始Y座標
+    long long origX;    //原始X座標(定點站點單位)
+    long long origY;    //原始Y座標(定點站點單位)
+    int widthSites;     //模組寬度(基準站點數，無條件進位)
+    int fitClass;       //放得下此模組的最低行高等級(Placement::rowHeights 的索引)
+    int rowIdx;         //所在行索引(-1 表示未放置)
+    int subRowIdx;      //所在子行索引
+    int site;           //子行內的起始站點
     bool isFixed;       //是否為固定模組
 
     Block()
-        : width(0.0), height(0.0), x(0.0), y(0.0),
-        origX(0.0), origY(0.0), isFixed(false) {}
+        : origX(0), origY(0), widthSites(0), fitClass(0),
+        rowIdx(-1), subRowIdx(-1), site(-1), isFixed(false) {}
+};
+
+//64 位元字的位元運算(x 不可為 0)
+inline int countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+inline int countLeadingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x >> 63)) { x <<= 1; ++n; }
+    return n;
+#endif
+}
+
+inline int countOnes(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for (; x; x &= x - 1) ++n;
+    return n;
+#endif
+}
+
+//站點空閒摘要：以 64 站點為一字的佔用位元圖，加上建在字上的線段樹
+//樹的每段維護空閒前綴、後綴、最長連續空閒站點數與空閒站點數，葉節點由 ctz/clz 計算
+//超出站點數的位元與補齊的字視為已佔用，因此找到的位置一定不會超出子行
+struct FreeSiteTree {
+    struct Node {
+        int pre;     //從左端開始的連續空閒數
+        int suf;     //到右端為止的連續空閒數
+        int best;    //最長連續空閒數
+        int free;    //空閒站點數
+    };
+    int size;                //葉節點(字)數，2 的冪次
+    vector<uint64_t> words;  //佔用位元圖，位元 i 為 1 表示站點 i 已佔用
+    vector<Node> nodes;      //nodes[1] 為根節點
+
+    FreeSiteTree() : size(0) {}
+
+    //重設為 n 個全空閒站點
+    void reset(int n) {
+        size = 1;
+        while (static_cast<long>(size) * 64 < n) size <<= 1;
+        words.assign(size, ~0ULL);
+        for (int w = 0; w * 64 < n; ++w) {
+            words[w] = (n - w * 64 >= 64) ? 0ULL : (~0ULL << (n - w * 64));
+        }
+        nodes.assign(2 * size, Node{ 0, 0, 0, 0 });
+        for (int w = 0; w < size; ++w) {
+            nodes[size + w] = leaf(words[w]);
+        }
+        int childLen = 64;
+        for (int first = size / 2; first >= 1; first /= 2, childLen *= 2) {
+            for (int i = first; i < 2 * first; ++i) {
+                pull(i, childLen);
+            }
+        }
+    }
+
+    void release() {
+        vector<uint64_t>().swap(words);
+        vector<Node>().swap(nodes);
+        size = 0;
+    }
+
+    //設定站點 [from, to) 的空閒狀態並向上更新
+    void setRange(int from, int to, bool free) {
+        from = max(from, 0);
+        to = min(to, size * 64);
+        if (from >= to) return;
+        int firstWord = from / 64;
+        int lastWord = (to - 1) / 64;
+        for (int w = firstWord; w <= lastWord; ++w) {
+            uint64_t mask = ~0ULL;
+            if (w == firstWord) mask &= ~0ULL << (from % 64);
+            if (w == lastWord) mask &= ~0ULL >> (63 - (to - 1) % 64);
+            if (free) words[w] &= ~mask;
+            else words[w] |= mask;
+            nodes[size + w] = leaf(words[w]);
+        }
+        int lo = (size + firstWord) / 2;
+        int hi = (size + lastWord) / 2;
+        for (int childLen = 64; lo >= 1; lo /= 2, hi /= 2, childLen *= 2) {
+            for (int i = lo; i <= hi; ++i) {
+                pull(i, childLen);
+            }
+        }
+    }
+
+    //站點 [from, to) 是否全部空閒
+    bool isFree(int from, int to) const {
+        if (from < 0 || to > size * 64) return false;
+        for (int s = from; s < to; s = (s / 64 + 1) * 64) {
+            int w = s / 64;
+            uint64_t mask = ~0ULL << (s % 64);
+            if (to < (w + 1) * 64) mask &= ~0ULL >> (63 - (to - 1) % 64);
+            if (words[w] & mask) return false;
+        }
+        return true;
+    }
+
+    //最長連續空閒站點數
+    int longest() const {
+        return nodes.empty() ? 0 : nodes[1].best;
+    }
+
+    //空閒站點數
+    int freeCount() const {
+        return nodes.empty() ? 0 : nodes[1].free;
+    }
+
+    //最小的起點 s ∈ [lo, hi] 使 [s, s+k) 全部空閒，找不到回傳 -1
+    int firstFit(int k, int lo, int hi) const {
+        if (nodes.empty() || lo > hi || k > nodes[1].best) return -1;
+        if (k <= 0) return max(lo, 0) <= hi ? max(lo, 0) : -1; //寬度為零的模組任何位置都放得下
+        int run = 0;
+        int s = firstFitFrom(1, 0, size * 64, k, max(lo, 0), run);
+        return (s >= 0 && s <= hi) ? s : -1;
+    }
+
+    //最大的起點 s ∈ [lo, hi] 使 [s, s+k) 全部空閒，找不到回傳 -1
+    int lastFit(int k, int lo, int hi) const {
+        if (nodes.empty() || lo > hi || k > nodes[1].best) return -1;
+        if (k <= 0) return max(lo, 0) <= hi ? hi : -1;
+        int run = 0;
+        int last = static_cast<int>(min<long>(static_cast<long>(hi) + k - 1, static_cast<long>(size) * 64 - 1));
+        int s = lastFitUntil(1, 0, size * 64, k, last, run);
+        return (s >= lo && s <= hi) ? s : -1;
+    }
+
+private:
+    //一個字的摘要
+    static Node leaf(uint64_t occupied) {
+        if (occupied == 0) return Node{ 64, 64, 64, 64 };
+        uint64_t free = ~occupied;
+        int best = 0;
+        for (uint64_t x = free; x; ) {
+            int start = countTrailingZeros(x);
+            x >>= start;
+            int len = (~x == 0) ? 64 - start : countTrailingZeros(~x);
+            best = max(best, len);
+            x = (len >= 64) ? 0 : (x >> len);
+        }
+        return Node{ countTrailingZeros(occupied), countLeadingZeros(occupied), best, countOnes(free) };
+    }
+
+    void pull(int i, int childLen) {
+        const Node& l = nodes[2 * i];
+        const Node& r = nodes[2 * i + 1];
+        Node& n = nodes[i];
+        n.pre = (l.pre == childLen) ? childLen + r.pre : l.pre;
+        n.suf = (r.suf == childLen) ? childLen + l.suf : r.suf;
+        n.best = max(max(l.best, r.best), l.suf + r.pre);
+        n.free = l.free + r.free;
+    }
+
+    //由左向右掃描 >= lo 的站點，run 為緊接在此節點之前的連續空閒數
+    int firstFitFrom(int i, int l, int len, int k, int lo, int& run) const {
+        if (l + len <= lo) return -1;
+        const Node& n = nodes[i];
+        if (l >= lo) {
+            if (run + n.pre >= k) return l - run;
+            if (n.best < k) {
+                run = (n.pre == len) ? run + len : n.suf;
+                return -1;
+            }
+        }
+        if (i >= size) return firstFitInWord(i - size, k, lo, run);
+        int half = len / 2;
+        int s = firstFitFrom(2 * i, l, half, k, lo, run);
+        if (s >= 0) return s;
+        return firstFitFrom(2 * i + 1, l + half, half, k, lo, run);
+    }
+
+    //由右向左掃描 <= last 的站點，run 為緊接在此節點之後的連續空閒數
+    int lastFitUntil(int i, int l, int len, int k, int last, int& run) const {
+        if (l > last) return -1;
+        const Node& n = nodes[i];
+        if (l + len - 1 <= last) {
+            if (run + n.suf >= k) return l + len + run - k;
+            if (n.best < k) {
+                run = (n.suf == len) ? run + len : n.pre;
+                return -1;
+            }
+        }
+        if (i >= size) return lastFitInWord(i - size, k, last, run);
+        int half = len / 2;
+        int s = lastFitUntil(2 * i + 1, l + half, half, k, last, run);
+        if (s >= 0) return s;
+        return lastFitUntil(2 * i, l, half, k, last, run);
+    }
+
+    //在字 w 內逐段掃描空閒區段，lo 之前的站點視為已佔用
+    int firstFitInWord(int w, int k, int lo, int& run) const {
+        int base = w * 64;
+        uint64_t free = ~words[w];
+        if (lo > base) free &= ~0ULL << (lo - base);
+        for (int pos = 0; pos < 64; ) {
+            uint64_t x = free >> pos;
+            if (x == 0) break;
+            int skip = countTrailingZeros(x);
+            if (skip > 0) run = 0;
+            pos += skip;
+            x >>= skip;
+            int len = (~x == 0) ? 64 - pos : countTrailingZeros(~x);
+            if (run + len >= k) return base + pos - run;
+            run = (pos + len == 64) ? run + len : 0;
+            pos += len;
+        }
+        if (free >> 63 == 0) run = 0;
+        return -1;
+    }
+
+    //在字 w 內由右向左逐段掃描空閒區段，last 之後的站點視為已佔用
+    int lastFitInWord(int w, int k, int last, int& run) const {
+        int base = w * 64;
+        uint64_t free = ~words[w];
+        if (last < base + 63) free &= ~0ULL >> (63 - (last - base));
+        for (int end = 64; end > 0; ) {
+            uint64_t x = free << (64 - end);
+            if (x == 0) break;
+            int skip = countLeadingZeros(x);
+            if (skip > 0) run = 0;
+            end -= skip;
+            x <<= skip;
+            int len = (~x == 0) ? end : countLeadingZeros(~x);
+            if (run + len >= k) return base + end + run - k;
+            run = (end - len == 0) ? run + len : 0;
+            end -= len;
+        }
+        if ((free & 1) == 0) run = 0;
+        return -1;
+    }
 };
 
 //子行結構
@@ -60,25 +746,35 @@ struct SubRow {
     double xEnd;                      //子行結束X座標
     double siteWidth;                 //子行的站點寬度
     int numSites;                     //子行的站點數量
-    vector<bool> occupiedSites;       //站點佔用狀態
-    vector<Block*> placedBlocks;      //已放置的模組按X排序
+    long long xUnits;                 //子行起始X座標(定點站點單位)
+    long long siteUnits;              //每個站點的定點單位數(基準站點寬度為 siteUnit)
+    vector<Block*> placedBlocks;      //已放置的模組按站點排序
+    FreeSiteTree freeSites;           //站點佔用位元圖與空閒摘要，隨插入與移除同步更新
 
+    //站點狀態在讀檔時不配置，由 activateRow 在行實際使用前建立；定點座標由 convertToSiteUnits 設定
     SubRow(double xs, int num, double sw)
-        : xStart(xs), xEnd(xs + num * sw), siteWidth(sw), numSites(num), occupiedSites(num, false) {}
+        : xStart(xs), xEnd(xs + num * sw), siteWidth(sw), numSites(num), xUnits(0), siteUnits(0) {}
+
+    //重設為全空閒
+    void resetSites() {
+        placedBlocks.clear();
+        freeSites.reset(numSites);
+    }
+
+    //釋放站點狀態(串流模式中離開視窗的行)
+    void releaseSites() {
+        vector<Block*>().swap(placedBlocks);
+        freeSites.release();
+    }
     
     //插入模組並保持已放置模組的排序
     void insertBlock(Block* block, int startSite, int sitesNeeded) {
-        placedBlocks.push_back(block);
-        //按照X排序
-        sort(placedBlocks.begin(), placedBlocks.end(), [](const Block* a, const Block* b) {
-            return a->x < b->x;
+        auto pos = lower_bound(placedBlocks.begin(), placedBlocks.end(), startSite, [](const Block* b, int s) {
+            return b->site < s;
         });
+        placedBlocks.insert(pos, block);
         //標記站點為已佔用
-        for(int i = startSite; i < startSite + sitesNeeded; ++i){
-            if(i >= 0 && i < numSites){
-                occupiedSites[i] = true;
-            }
-        }
+        freeSites.setRange(startSite, min(startSite + sitesNeeded, numSites), false);
     }
     
     //移除模組
@@ -88,11 +784,7 @@ struct SubRow {
             placedBlocks.erase(it);
         }
         //標記為未佔用
-        for(int i = startSite; i < startSite + sitesNeeded; ++i){
-            if(i >= 0 && i < numSites){
-                occupiedSites[i] = false;
-            }
-        }
+        freeSites.setRange(startSite, min(startSite + sitesNeeded, numSites), true);
     }
     
     //查是否可以從startSite開始放置需要的數
@@ -100,12 +792,7 @@ struct SubRow {
         if(startSite + sitesNeeded > numSites){
             return false;
         }
-        for(int i = startSite; i < startSite + sitesNeeded; ++i){
-            if(occupiedSites[i]){
-                return false;
-            }
-        }
-        return true;
+        return freeSites.isFree(startSite, startSite + sitesNeeded);
     }
 };
 
@@ -115,11 +802,90 @@ struct Row {
     double height;                  //高度
     double siteWidth;               //寬度
     double siteSpacing;             //間距
+    bool baseSiteWidth;             //站點寬度是否等於佈局的基準站點寬度
+    long long yUnits;               //起始Y座標(定點站點單位)
+    long long heightUnits;          //高度(定點站點單位)
+    long long siteUnits;            //每個站點的定點單位數
+    int heightClass;                //行高等級(Placement::rowHeights 的索引)
     vector<SubRow> subRows;         //行中的子行
 
     Row()
         : yStart(0.0), height(0.0), siteWidth(0.0),
-        siteSpacing(0.0) {}
+        siteSpacing(0.0), baseSiteWidth(true), yUnits(0), heightUnits(0), siteUnits(0), heightClass(0) {}
+};
+
+//行層級空閒摘要：依Y座標順序(rank)排列的線段樹，維護每段行中最長的連續空閒長度與空閒站點總數
+//長度以定點站點單位表示，不同站點寬度的行可以直接比較；查詢最近的放得下的行為 O(log n)
+struct RowFreeTree {
+    struct Node {
+        long long longest;   //最長連續空閒長度
+        long long free;      //空閒站點數
+    };
+    long size;               //葉節點數(2 的冪次)
+    vector<Node> nodes;      //nodes[1] 為根節點
+
+    RowFreeTree() : size(0) {}
+
+    //重設為 n 行，全部沒有空閒空間(行啟用時再更新)
+    void reset(size_t n) {
+        size = 1;
+        while (size < static_cast<long>(n)) size <<= 1;
+        nodes.assign(2 * size, Node{ 0, 0 });
+    }
+
+    void update(size_t rank, long long longest, long long free) {
+        long i = size + static_cast<long>(rank);
+        nodes[i] = Node{ longest, free };
+        for (i /= 2; i >= 1; i /= 2) {
+            nodes[i].longest = max(nodes[2 * i].longest, nodes[2 * i + 1].longest);
+            nodes[i].free = nodes[2 * i].free + nodes[2 * i + 1].free;
+        }
+    }
+
+    //[lo, hi] 內的空閒站點總數
+    long long freeSites(long lo, long hi) const {
+        long long total = 0;
+        lo = max(lo, 0L);
+        hi = min(hi, size - 1);
+        for (long l = lo + size, r = hi + size + 1; l < r; l /= 2, r /= 2) {
+            if (l & 1) total += nodes[l++].free;
+            if (r & 1) total += nodes[--r].free;
+        }
+        return total;
+    }
+
+    //[lo, hi] 內最小的 rank 使連續空閒長度至少為 width，找不到回傳 -1
+    long nextFit(long lo, long hi, long long width) const {
+        lo = max(lo, 0L);
+        hi = min(hi, size - 1);
+        if (nodes.empty() || lo > hi) return -1;
+        return nextFitIn(1, 0, size, lo, hi, width);
+    }
+
+    //[lo, hi] 內最大的 rank 使連續空閒長度至少為 width，找不到回傳 -1
+    long prevFit(long lo, long hi, long long width) const {
+        lo = max(lo, 0L);
+        hi = min(hi, size - 1);
+        if (nodes.empty() || lo > hi) return -1;
+        return prevFitIn(1, 0, size, lo, hi, width);
+    }
+
+private:
+    long nextFitIn(long i, long l, long len, long lo, long hi, long long width) const {
+        if (l > hi || l + len - 1 < lo || nodes[i].longest < width) return -1;
+        if (len == 1) return l;
+        long half = len / 2;
+        long r = nextFitIn(2 * i, l, half, lo, hi, width);
+        return r >= 0 ? r : nextFitIn(2 * i + 1, l + half, half, lo, hi, width);
+    }
+
+    long prevFitIn(long i, long l, long len, long lo, long hi, long long width) const {
+        if (l > hi || l + len - 1 < lo || nodes[i].longest < width) return -1;
+        if (len == 1) return l;
+        long half = len / 2;
+        long r = prevFitIn(2 * i + 1, l + half, half, lo, hi, width);
+        return r >= 0 ? r : prevFitIn(2 * i, l, half, lo, hi, width);
+    }
 };
 
 // 布局結構
@@ -128,27 +894,355 @@ struct Placement {
     vector<Row> rows;                     //所有行
     double maxX;                          //最大X座標
     double maxY;                          //最大Y座標
+    double siteWidth;                     //基準站點寬度(整數站點座標的單位)
+    bool uniformGeometry;                 //所有行的站點寬度、高度與行距是否一致
+    long long rowPitch;                   //一致時的行距(定點站點單位)
+    vector<double> rowHeights;            //由低到高排列的相異行高(行高等級)
+    long long searchMargin;               //優化時在目前位移之外多搜尋的距離(原始單位 20，定點站點單位)
+    size_t rowBegin;                      //可使用的行範圍起點(串流模式的滑動視窗)
+    size_t rowEnd;                        //可使用的行範圍終點(不含)
+    vector<size_t> rowOrder;              //依Y座標排序的行索引(rank 對應行索引)
+    vector<size_t> rowRank;               //行索引對應的 rank
+    RowFreeTree rowFree;                  //依 rank 排列的行層級空閒摘要
+    unordered_map<string, Position> fixedPositions; //固定模組的原始座標(輸出時使用，避免定點換算誤差)
+
+    Placement() : maxX(0.0), maxY(0.0), siteWidth(0.0), uniformGeometry(false), rowPitch(0), searchMargin(0),
+        rowBegin(0), rowEnd(0) {}
+};
+
+//重新計算一行的最長連續空閒長度與空閒站點數並更新行層級摘要
+inline void refreshRowSummary(Placement& placement, size_t rowIdx) {
+    long long longest = 0;
+    long long free = 0;
+    for (const auto& subrow : placement.rows[rowIdx].subRows) {
+        longest = max(longest, subrow.freeSites.longest() * subrow.siteUnits);
+        free += subrow.freeSites.freeCount();
+    }
+    placement.rowFree.update(placement.rowRank[rowIdx], longest, free);
+}
+
+// 行的站點佔用只在使用時配置：一般流程在載入後啟用所有行，串流模式在行進入視窗時配置、離開時釋放
+inline void activateRow(Placement& placement, size_t rowIdx) {
+    for (auto& subrow : placement.rows[rowIdx].subRows) {
+        subrow.resetSites();
+    }
+    refreshRowSummary(placement, rowIdx);
+}
+
+inline void releaseRow(Placement& placement, size_t rowIdx) {
+    for (auto& subrow : placement.rows[rowIdx].subRows) {
+        subrow.releaseSites();
+    }
+    refreshRowSummary(placement, rowIdx);
+}
+
+//放置與移除模組，同步更新子行與行層級摘要
+inline void placeBlock(Placement& placement, Block* block, int rowIdx, int subRowIdx, int site, int sitesNeeded) {
+    block->rowIdx = rowIdx;
+    block->subRowIdx = subRowIdx;
+    block->site = site;
+    placement.rows[rowIdx].subRows[subRowIdx].insertBlock(block, site, sitesNeeded);
+    refreshRowSummary(placement, rowIdx);
+}
+
+inline void unplaceBlock(Placement& placement, Block* block, int sitesNeeded) {
+    placement.rows[block->rowIdx].subRows[block->subRowIdx].removeBlock(block, block->site, sitesNeeded);
+    refreshRowSummary(placement, block->rowIdx);
+    block->rowIdx = -1;
+    block->subRowIdx = -1;
+    block->site = -1;
+}
+
+//線網(CSR 格式)：第 i 條線網的接腳為 [netStart[i], netStart[i+1])
+struct NetList {
+    vector<int> netStart;     //每條線網第一個接腳的索引
+    vector<int> pinCell;      //接腳所屬模組的編號
+    vector<float> pinDx;      //接腳相對模組中心的X偏移
+    vector<float> pinDy;      //接腳相對模組中心的Y偏移
+};
+
+//以陣列存放的設計資料(檢查與繪圖模式使用)
+struct DesignArrays {
+    vector<string> names;                 //模組名稱(依名稱排序)
+    unordered_map<string, int> cellIndex; //名稱對應編號
+    vector<double> widths;                //模組寬度
+    vector<double> heights;               //模組高度
+    vector<bool> fixedCell;               //是否為固定模組
+    vector<Row> rows;                     //所有行
+};
+
+//合法性檢查結果
+struct LegalityReport {
+    size_t overlaps;          //可移動模組互相重疊
+    size_t overTerminal;      //可移動模組壓在固定模組上
+    size_t offRow;            //未對齊任何行
+    size_t offSite;           //未對齊站點
+    size_t outsideSubrow;     //超出子行範圍
+    size_t tooTall;           //高於行高
+    size_t missing;           //輸出中缺少的模組
+    vector<string> examples;  //部分違規範例
+
+    LegalityReport() : overlaps(0), overTerminal(0), offRow(0), offSite(0),
+        outsideSubrow(0), tooTall(0), missing(0) {}
+};
+
+//移動限制範圍(定點站點單位)：移動後的模組須位於 [xLo, xHi] 內且所在行的Y座標位於 [yLo, yHi] 內(預設不限)
+struct MoveWindow {
+    long long xLo, xHi, yLo, yHi;
+
+    MoveWindow() : xLo(numeric_limits<long long>::min()), xHi(numeric_limits<long long>::max()),
+        yLo(numeric_limits<long long>::min()), yHi(numeric_limits<long long>::max()) {}
+    MoveWindow(long long x0, long long x1, long long y0, long long y1) : xLo(x0), xHi(x1), yLo(y0), yHi(y1) {}
+};
+
+//多層級合法化的一層：超級模組由下一層(較細)同一行中X相鄰的模組合併而成
+struct CoarseLevel {
+    unordered_map<string, Block> blocks;             //本層的模組(未合併的模組沿用原名稱)
+    unordered_map<string, vector<string>> members;   //超級模組對應的下一層成員(依X排序)
+};
+
+//時間預算：優化在截止時間前隨時可停止，並定期輸出進度
+struct TimeBudget {
+    chrono::steady_clock::time_point start;   //計時起點
+    double limit;                             //時間上限(秒，0 表示不限)
+    double logInterval;                       //進度輸出間隔(秒，0 表示不輸出)
+
+    TimeBudget() : start(chrono::steady_clock::now()), limit(0.0), logInterval(0.0) {}
+
+    double elapsed() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    bool expired() const {
+        return limit > 0.0 && elapsed() >= limit;
+    }
+};
+
+//初始合法化引擎
+enum class PlacementEngine {
+    FirstFit,    //依Y再依X排序，逐行尋找最左側可用位置
+    Sweep        //Tetris式掃描：依X排序，每個子行維護前緣
+};
+
+//命令列選項
+struct Options {
+    size_t streamBandRows;   //串流模式每個帶狀區的行數(0 表示不使用串流)
+    size_t sortChunkLines;   //外部排序每個分塊的行數
+    double timeLimit;        //優化的時間上限(秒，0 表示不限)
+    double logInterval;      //進度輸出間隔(秒，負值表示依是否有時間上限決定)
+    PlacementEngine engine;  //初始合法化引擎
+    bool reportEngine;       //是否輸出初始合法化的時間與品質
+    int sweepRows;           //掃描引擎每個模組考慮的最近行數
+    bool check;              //合法化後檢查輸出並計算線長
+    bool checkOnly;          //只檢查既有的輸出，不重新合法化
+    int threads;             //平行處理的執行緒數
+    bool render;             //繪製既有的輸出，不重新合法化
+    int renderWidth;         //影像寬度(像素)
+    int tileSize;            //圖塊邊長(像素)
+    bool zoom;               //是否只繪製指定範圍
+    double zoomX0, zoomY0, zoomX1, zoomY1; //繪製範圍(設計座標)
+    Compression compression; //輸出檔案的壓縮格式
+    int multilevel;          //多層級合法化的粗化層數(0 表示不使用)
+
+    Options() : streamBandRows(0), sortChunkLines(1000000), timeLimit(0.0), logInterval(-1.0),
+        engine(PlacementEngine::FirstFit), reportEngine(false), sweepRows(8),
+        check(false), checkOnly(false), threads(max(1, static_cast<int>(thread::hardware_concurrency()))),
+        render(false), renderWidth(4096), tileSize(1024), zoom(false),
+        zoomX0(0.0), zoomY0(0.0), zoomX1(0.0), zoomY1(0.0), compression(Compression::None),
+        multilevel(0) {}
+};
+
+//模組的原始座標與尺寸換算為定點站點單位、寬度站點數與行高等級，並重置放置狀態
+//行高的容許誤差只在此處比較一次，之後只比較整數等級
+inline void convertBlockToSiteUnits(Block& block, const Placement& placement, double x, double y, double width, double height) {
+    block.origX = toSiteUnits(x, placement.siteWidth);
+    block.origY = toSiteUnits(y, placement.siteWidth);
+    block.widthSites = static_cast<int>(ceil(width / placement.siteWidth));
+    block.fitClass = static_cast<int>(lower_bound(placement.rowHeights.begin(), placement.rowHeights.end(), height - 1e-6)
+        - placement.rowHeights.begin());
+    block.rowIdx = -1;
+    block.subRowIdx = -1;
+    block.site = -1;
+}
+
+//模組在指定行中需要的站點數(非基準站點寬度的行由基準站點數換算，可能多佔一個站點)
+inline int sitesNeededIn(const Block* block, const Row& row) {
+    if (row.baseSiteWidth) {
+        return block->widthSites;
+    }
+    return static_cast<int>(ceilDiv(block->widthSites * siteUnit, row.siteUnits));
+}
+
+//整數放置狀態的定點座標(搜尋與位移計算使用)
+inline long long blockXUnits(const Placement& placement, const Block& block) {
+    if (block.rowIdx < 0) {
+        return block.origX;
+    }
+    const SubRow& subrow = placement.rows[block.rowIdx].subRows[block.subRowIdx];
+    return subrow.xUnits + block.site * subrow.siteUnits;
+}
+
+inline long long blockYUnits(const Placement& placement, const Block& block) {
+    if (block.rowIdx < 0) {
+        return block.origY;
+    }
+    return placement.rows[block.rowIdx].yUnits;
+}
+
+//曼哈頓位移(定點站點單位)
+inline long long blockDisplacement(const Placement& placement, const Block& block) {
+    return llabs(blockXUnits(placement, block) - block.origX) + llabs(blockYUnits(placement, block) - block.origY);
+}
 
-    Placement() : maxX(0.0), maxY(0.0) {}
+//整數放置狀態轉回原始單位(只在輸出時使用)；固定模組直接輸出讀入的座標
+inline double blockX(const Placement& placement, const Block& block) {
+    if (block.rowIdx < 0) {
+        auto it = placement.fixedPositions.find(block.name);
+        return it != placement.fixedPositions.end() ? it->second.x : fromSiteUnits(block.origX, placement.siteWidth);
+    }
+    const SubRow& subrow = placement.rows[block.rowIdx].subRows[block.subRowIdx];
+    return subrow.xStart + block.site * subrow.siteWidth;
+}
+
+inline double blockY(const Placement& placement, const Block& block) {
+    if (block.rowIdx < 0) {
+        auto it = placement.fixedPositions.find(block.name);
+        return it != placement.fixedPositions.end() ? it->second.y : fromSiteUnits(block.origY, placement.siteWidth);
+    }
+    return placement.rows[block.rowIdx].yStart;
+}
+
+//一般行幾何：每行的站點寬度與高度各自讀取
+struct GeneralGeometry {
+    long long siteUnits(const SubRow& subrow) const { return subrow.siteUnits; }
+    //距子行起點 dx 的位置向下/向上取整的站點，基準站點寬度的行以位移取代除法
+    long long floorSites(const SubRow& subrow, long long dx) const {
+        return subrow.siteUnits == siteUnit ? dx >> siteShift : floorDiv(dx, subrow.siteUnits);
+    }
+    long long ceilSites(const SubRow& subrow, long long dx) const {
+        return subrow.siteUnits == siteUnit ? -((-dx) >> siteShift) : ceilDiv(dx, subrow.siteUnits);
+    }
+    int sitesNeeded(const Block* block, const Row& row) const { return sitesNeededIn(block, row); }
+    bool fits(const Block* block, const Row& row) const { return block->fitClass <= row.heightClass; }
+
+    //Y座標不大於y的最大 rank(沒有則為 -1)，以二分搜尋依Y排序的行
+    long rowBelow(const Placement& placement, long long y) const {
+        const vector<Row>& rows = placement.rows;
+        auto it = upper_bound(placement.rowOrder.begin(), placement.rowOrder.end(), y, [&](long long v, size_t r) {
+            return v < rows[r].yUnits;
+        });
+        return static_cast<long>(it - placement.rowOrder.begin()) - 1;
+    }
+
+    //Y座標落在[yLo, yHi]內的 rank 範圍[first, last)
+    void rowRange(const Placement& placement, long long yLo, long long yHi, size_t& first, size_t& last) const {
+        const vector<Row>& rows = placement.rows;
+        auto lo = lower_bound(placement.rowOrder.begin(), placement.rowOrder.end(), yLo, [&](size_t r, long long v) {
+            return rows[r].yUnits < v;
+        });
+        auto hi = upper_bound(lo, placement.rowOrder.end(), yHi, [&](long long v, size_t r) {
+            return v < rows[r].yUnits;
+        });
+        first = min(max(static_cast<size_t>(lo - placement.rowOrder.begin()), placement.rowBegin), placement.rowEnd);
+        last = min(max(static_cast<size_t>(hi - placement.rowOrder.begin()), placement.rowBegin), placement.rowEnd);
+    }
+};
+
+//一致行幾何：站點寬度、行高與行距對所有行相同，行索引可直接由座標算出
+//站點寬度固定為編譯期常數 siteUnit，站點換算只需位移；所有行同一行高等級
+struct UniformGeometry {
+    long long y0;       //第一行的Y座標
+    long long pitch;    //行距
+
+    explicit UniformGeometry(const Placement& placement)
+        : y0(placement.rows.front().yUnits), pitch(placement.rowPitch) {}
+
+    long long siteUnits(const SubRow&) const { return siteUnit; }
+    long long floorSites(const SubRow&, long long dx) const { return dx >> siteShift; }
+    long long ceilSites(const SubRow&, long long dx) const { return -((-dx) >> siteShift); }
+    int sitesNeeded(const Block* block, const Row&) const { return block->widthSites; }
+    bool fits(const Block* block, const Row&) const { return block->fitClass == 0; }
+
+    //一致行幾何的行已依Y排序(rank 即行索引)，直接由座標算出，不需搜尋
+    long rowBelow(const Placement&, long long y) const {
+        return static_cast<long>(floorDiv(y - y0, pitch));
+    }
+
+    void rowRange(const Placement& placement, long long yLo, long long yHi, size_t& first, size_t& last) const {
+        long begin = static_cast<long>(placement.rowBegin);
+        long n = static_cast<long>(placement.rowEnd);
+        long lo = static_cast<long>(ceilDiv(yLo - y0, pitch));
+        long hi = static_cast<long>(floorDiv(yHi - y0, pitch)) + 1;
+        first = static_cast<size_t>(min(max(lo, begin), n));
+        last = static_cast<size_t>(min(max(hi, begin), n));
+    }
 };
 
+//依佈局的行幾何建立對應的幾何策略並呼叫 fn(geometry)，各核心只在此處選擇特化版本
+template <class F>
+void withGeometry(const Placement& placement, F&& fn) {
+    if (placement.uniformGeometry) {
+        fn(UniformGeometry(placement));
+    }
+    else {
+        fn(GeneralGeometry());
+    }
+}
+
 //宣告
 void parseAuxFile(const string& filename, unordered_map<string, string>& files);
 void parseNodesFile(const string& filename, unordered_map<string, Node>& nodes);
+void forEachNode(const string& filename, const function<void(const Node&)>& fn);
 void parsePlFile(const string& filename, unordered_map<string, Position>& positions);
+void forEachPosition(const string& filename, const function<void(const string&, const Position&)>& fn);
 void parseSclFile(const string& filename, vector<Row>& rows, double& maxX, double& maxY);
+void convertToSiteUnits(Placement& placement);
+template <class Geometry> void initialPlacementImpl(Placement& placement, const Geometry& geometry);
+template <class Geometry> long long improveBlockImpl(Placement& placement, const Geometry& geometry, Block* block, const MoveWindow& window);
+template <class Geometry> void optimizePlacementImpl(Placement& placement, const Geometry& geometry, const TimeBudget& budget);
+template <class Geometry> void sweepPlacementImpl(Placement& placement, const Geometry& geometry, int nearRows);
+template <class Geometry> void refinePlacementImpl(Placement& placement, const Geometry& geometry,
+    vector<pair<Block*, MoveWindow>>& cells, const TimeBudget& budget);
 void initialPlacement(Placement& placement);
-void optimizePlacement(Placement& placement);
+void sweepPlacement(Placement& placement, int nearRows);
+void runInitialPlacement(Placement& placement, const Options& options);
+void optimizePlacement(Placement& placement, const TimeBudget& budget = TimeBudget());
+void refinePlacement(Placement& placement, vector<pair<Block*, MoveWindow>>& cells, const TimeBudget& budget);
+size_t coarsenLevel(const Placement& placement, const unordered_map<string, Block>& fine, CoarseLevel& coarse, int level);
+void uncoarsenLevel(Placement& placement, const CoarseLevel& coarse, unordered_map<string, Block>& fine,
+    vector<pair<Block*, MoveWindow>>& refineCells);
+void multilevelPlacement(Placement& placement, const Options& options, const TimeBudget& budget);
 double calculateTotalDisplacement(const Placement& placement, double& maxDisplacement);
-void writePlFile(const string& filename, const Placement& placement);
-void writeNodesFile(const string& filename, const unordered_map<string, Node>& nodes);
-void writeSclFile(const string& filename, const vector<Row>& rows);
-void writeAuxFile(const string& filename, const string& outputFilePrefix);
-void copyFile(const string& srcFilename, const string& destFilename);
+void closeOutputFile(OutputFile& outfile, const string& filename);
+void writePlFile(const string& filename, const Placement& placement, Compression compression = Compression::None);
+void writeNodesFile(const string& filename, const unordered_map<string, Node>& nodes, Compression compression = Compression::None);
+void writeSclFile(const string& filename, const vector<Row>& rows, Compression compression = Compression::None);
+void writeAuxFile(const string& filename, const string& outputFilePrefix, const string& suffix = "");
+void copyFile(const string& srcFilename, const string& destFilename, Compression compression = Compression::None);
+void externalSort(const string& inPath, const string& outPath, size_t chunkLines,
+    const function<bool(const string&, const string&)>& less);
+size_t nearestRowIndex(const Placement& placement, long long y);
+bool streamLegalize(const unordered_map<string, string>& files, const string& outputFile,
+    Placement& placement, const Options& options, const TimeBudget& budget,
+    double& totalDisplacement, double& maxDisplacement);
+void parallelFor(size_t n, int numThreads, const function<void(size_t, size_t, int)>& fn);
+void parseNetsFile(const string& filename, const unordered_map<string, int>& cellIndex, NetList& nets);
+double computeHpwl(const NetList& nets, const vector<double>& centerX, const vector<double>& centerY, int numThreads);
+LegalityReport checkLegality(const vector<Row>& rows, const vector<string>& names,
+    const vector<double>& widths, const vector<double>& heights, const vector<bool>& fixedCell,
+    const vector<double>& xs, const vector<double>& ys, const vector<bool>& present, int numThreads);
+void loadDesignArrays(const unordered_map<string, string>& files, DesignArrays& design);
+void loadCellPositions(const string& filename, const DesignArrays& design,
+    vector<double>& xs, vector<double>& ys, vector<bool>& present);
+bool runChecker(const unordered_map<string, string>& files, const string& plFilename, int numThreads);
+void writePpmFile(const string& filename, int width, int height, const vector<unsigned char>& pixels);
+bool runRenderer(const unordered_map<string, string>& files, const string& outputFile, const string& plFilename,
+    const Options& options);
+template <class T> bool parseIntOption(const string& name, const string& text, long long minValue, T& value);
+bool parseDoubleOption(const string& name, const string& text, double minValue, double& value);
 
 // AUX讀檔
 void parseAuxFile(const string& filename, unordered_map<string, string>& files) {
-    ifstream infile(filename);
+    InputFile infile(filename);
     if (!infile) {
         cerr << "無法打開 .aux 檔案：" << filename << endl;
         exit(1);
@@ -191,13 +1285,24 @@ void parseAuxFile(const string& filename, unordered_map<string, string>& files)
 
 // .nodes讀檔
 void parseNodesFile(const string& filename, unordered_map<string, Node>& nodes) {
-    ifstream infile(filename);
-    if (!infile) {
-        cerr << "無法打開 .nodes 檔案：" << filename << endl;
-        exit(1);
-    }
-    string line;
-    bool headerSkipped = false;
+    forEachNode(filename, [&](const Node& node) {
+        // 檢查是否已存在相同名稱的模組
+        if(nodes.find(node.name) != nodes.end()){
+            cerr << "警告：發現重複的模組名稱：" << node.name << "，將覆蓋之前的模組。" << endl;
+        }
+        nodes[node.name] = node;
+    });
+}
+
+// .nodes逐行讀取，每個模組呼叫一次fn
+void forEachNode(const string& filename, const function<void(const Node&)>& fn) {
+    InputFile infile(filename);
+    if (!infile) {
+        cerr << "無法打開 .nodes 檔案：" << filename << endl;
+        exit(1);
+    }
+    string line;
+    bool headerSkipped = false;
     int lineCount = 0; // 計數讀取的模組數量
     while (getline(infile, line)) {
         if (line.empty() || line[0] == '#') continue;
@@ -235,11 +1340,7 @@ void parseNodesFile(const string& filename, unordered_map<string, Node>& nodes)
                 // cout << "模組 " << name << " 的標籤: " << terminalStr << " 不是 'terminal' 或 'fixed'，忽略。" << endl;
             }
         }
-        // 檢查是否已存在相同名稱的模組
-        if(nodes.find(node.name) != nodes.end()){
-            cerr << "警告：發現重複的模組名稱：" << node.name << "，將覆蓋之前的模組。" << endl;
-        }
-        nodes[node.name] = node;
+        fn(node);
         lineCount++;
     }
     // 除錯
@@ -248,7 +1349,14 @@ void parseNodesFile(const string& filename, unordered_map<string, Node>& nodes)
 
 // .pl 讀檔
 void parsePlFile(const string& filename, unordered_map<string, Position>& positions) {
-    ifstream infile(filename);
+    forEachPosition(filename, [&](const string& name, const Position& pos) {
+        positions[name] = pos;
+    });
+}
+
+// .pl逐行讀取，每個模組位置呼叫一次fn
+void forEachPosition(const string& filename, const function<void(const string&, const Position&)>& fn) {
+    InputFile infile(filename);
     if (!infile) {
         cerr << "無法打開 .pl 檔案：" << filename << endl;
         exit(1);
@@ -287,7 +1395,7 @@ void parsePlFile(const string& filename, unordered_map<string, Position>& positi
         // 除錯：輸出解析後的模組名稱和座標
         //cout << "解析到模組: \"" << name << "\", X: " << x << ", Y: " << y << "\n";
 
-        positions[name] = { x, y };
+        fn(name, { x, y });
     }
 
     // 除錯：輸出解析後的所有模組
@@ -296,7 +1404,7 @@ void parsePlFile(const string& filename, unordered_map<string, Position>& positi
 
 // .scl 讀檔
 void parseSclFile(const string& filename, vector<Row>& rows, double& maxX, double& maxY) {
-    ifstream infile(filename);
+    InputFile infile(filename);
     if (!infile) {
         cerr << "無法打開 .scl 檔案：" << filename << endl;
         exit(1);
@@ -416,86 +1524,139 @@ void parseSclFile(const string& filename, vector<Row>& rows, double& maxX, doubl
     }
 }
 
+// 載入後一次性將行轉換為定點站點座標並建立行高等級；模組由 convertBlockToSiteUnits 在之後換算
+void convertToSiteUnits(Placement& placement) {
+    placement.siteWidth = placement.rows.empty() ? 1.0 : placement.rows[0].siteWidth;
+    placement.searchMargin = toSiteUnits(20.0, placement.siteWidth);
+    placement.rowHeights.clear();
+    for (auto& row : placement.rows) {
+        row.baseSiteWidth = (row.siteWidth == placement.siteWidth);
+        row.yUnits = toSiteUnits(row.yStart, placement.siteWidth);
+        row.heightUnits = toSiteUnits(row.height, placement.siteWidth);
+        row.siteUnits = row.baseSiteWidth ? siteUnit : toSiteUnits(row.siteWidth, placement.siteWidth);
+        for (auto& subrow : row.subRows) {
+            subrow.xUnits = toSiteUnits(subrow.xStart, placement.siteWidth);
+            subrow.siteUnits = (subrow.siteWidth == placement.siteWidth) ? siteUnit : toSiteUnits(subrow.siteWidth, placement.siteWidth);
+        }
+        placement.rowHeights.push_back(row.height);
+    }
+    sort(placement.rowHeights.begin(), placement.rowHeights.end());
+    placement.rowHeights.erase(unique(placement.rowHeights.begin(), placement.rowHeights.end()), placement.rowHeights.end());
+    for (auto& row : placement.rows) {
+        row.heightClass = static_cast<int>(lower_bound(placement.rowHeights.begin(), placement.rowHeights.end(), row.height)
+            - placement.rowHeights.begin());
+    }
+
+    // 偵測一致的行幾何(站點寬度、行高、行距皆相同)
+    placement.uniformGeometry = !placement.rows.empty() && placement.rowHeights.size() == 1;
+    placement.rowPitch = placement.rows.empty() ? 0 : placement.rows[0].heightUnits;
+    if (placement.rows.size() > 1) {
+        placement.rowPitch = placement.rows[1].yUnits - placement.rows[0].yUnits;
+    }
+    for (size_t i = 0; i < placement.rows.size() && placement.uniformGeometry; ++i) {
+        const Row& row = placement.rows[i];
+        if (!row.baseSiteWidth || placement.rowPitch <= 0 ||
+            (i > 0 && row.yUnits - placement.rows[i - 1].yUnits != placement.rowPitch)) {
+            placement.uniformGeometry = false;
+        }
+        for (const auto& subrow : row.subRows) {
+            if (subrow.siteUnits != siteUnit) {
+                placement.uniformGeometry = false;
+            }
+        }
+    }
+    placement.rowBegin = 0;
+    placement.rowEnd = placement.rows.size();
+
+    // 行依Y座標排序的順序與行層級摘要(行啟用前沒有空閒空間)
+    placement.rowOrder.resize(placement.rows.size());
+    iota(placement.rowOrder.begin(), placement.rowOrder.end(), 0);
+    stable_sort(placement.rowOrder.begin(), placement.rowOrder.end(), [&](size_t a, size_t b) {
+        return placement.rows[a].yUnits < placement.rows[b].yUnits;
+    });
+    placement.rowRank.resize(placement.rows.size());
+    for (size_t k = 0; k < placement.rowOrder.size(); ++k) {
+        placement.rowRank[placement.rowOrder[k]] = k;
+    }
+    placement.rowFree.reset(placement.rows.size());
+}
+
 // 初始擺放
-void initialPlacement(Placement& placement) {
-    vector<Block*> movableBlocks; // 收集可移動的模組
+template <class Geometry>
+void initialPlacementImpl(Placement& placement, const Geometry& geometry) {
+    vector<Block*> movableBlocks; // 收集尚未放置的可移動模組
     for (auto& kv : placement.blocks) {
-        if (!kv.second.isFixed) {
+        if (!kv.second.isFixed && kv.second.rowIdx < 0) {
             movableBlocks.push_back(&kv.second);
         }
     }
 
     // 按照模組的原始位置排序，從上到下、從左到右
     sort(movableBlocks.begin(), movableBlocks.end(), [](Block* a, Block* b) {
-        if (fabs(a->origY - b->origY) > 1e-6)
+        if (a->origY != b->origY)
             return a->origY < b->origY;
         return a->origX < b->origX;
     });
 
     // 遍歷所有可移動模組進行放置
+    const RowFreeTree& rowFree = placement.rowFree;
+    long begin = static_cast<long>(placement.rowBegin);
+    long end = static_cast<long>(placement.rowEnd);
     for (auto& block : movableBlocks) {
         bool placed = false;
 
-        // 按照與原始Y座標的距離，對行進行排序
-        vector<size_t> rowIndices(placement.rows.size());
-        iota(rowIndices.begin(), rowIndices.end(), 0);
-
-        sort(rowIndices.begin(), rowIndices.end(), [&](size_t a, size_t b) {
-            double yDiffA = abs(placement.rows[a].yStart - block->origY);
-            double yDiffB = abs(placement.rows[b].yStart - block->origY);
-            return yDiffA < yDiffB;
-        });
-
-        for (size_t idx : rowIndices) {
+        // 由最近的行向兩側依距離展開，以行層級摘要直接跳過沒有足夠連續空閒空間的行
+        long long width = block->widthSites * siteUnit;
+        long below = min(max(geometry.rowBelow(placement, block->origY), begin - 1), end - 1);
+        long above = rowFree.nextFit(below + 1, end - 1, width);
+        below = rowFree.prevFit(begin, below, width);
+        while (below >= 0 || above >= 0) {
+            long rank;
+            if (above < 0 || (below >= 0 && llabs(placement.rows[placement.rowOrder[below]].yUnits - block->origY) <=
+                llabs(placement.rows[placement.rowOrder[above]].yUnits - block->origY))) {
+                rank = below;
+                below = rowFree.prevFit(begin, below - 1, width);
+            }
+            else {
+                rank = above;
+                above = rowFree.nextFit(above + 1, end - 1, width);
+            }
+            size_t idx = placement.rowOrder[rank];
             Row& row = placement.rows[idx];
 
             // 檢查模組高度是否小於等於行高度
-            if (block->height > row.height + 1e-6) {
+            if (!geometry.fits(block, row)) {
                 continue; // 模組太高，無法放入此行
             }
 
-            // 計算模組需要的站點數，向上取整
-            int sitesNeeded = ceil(block->width / row.siteWidth);
+            // 模組需要的站點數(已預先計算)
+            int sitesNeeded = geometry.sitesNeeded(block, row);
 
             // 將子行按照與模組x座標的距離排序
             vector<size_t> subrowIndices(row.subRows.size());
             iota(subrowIndices.begin(), subrowIndices.end(), 0);
 
+            // 以兩倍座標比較與子行中心的距離，避免除以二
             sort(subrowIndices.begin(), subrowIndices.end(), [&](size_t a, size_t b) {
-                double xCenterA = (row.subRows[a].xStart + row.subRows[a].xEnd) / 2.0;
-                double xCenterB = (row.subRows[b].xStart + row.subRows[b].xEnd) / 2.0;
-                double xDiffA = abs(xCenterA - block->origX);
-                double xDiffB = abs(xCenterB - block->origX);
+                const SubRow& subA = row.subRows[a];
+                const SubRow& subB = row.subRows[b];
+                long long xDiffA = llabs(2 * subA.xUnits + subA.numSites * subA.siteUnits - 2 * block->origX);
+                long long xDiffB = llabs(2 * subB.xUnits + subB.numSites * subB.siteUnits - 2 * block->origX);
                 return xDiffA < xDiffB;
             });
 
             for (size_t subIdx : subrowIndices) {
                 SubRow& subrow = row.subRows[subIdx];
 
-                // 遍歷子行的所有站點尋找連續的可用站點
-                for(int startSite = 0; startSite <= subrow.numSites - sitesNeeded; ++startSite){
-                    if(subrow.canPlaceAt(startSite, sitesNeeded)){
-                        // 計算對齊後的 x 座標
-                        double alignedX = subrow.xStart + startSite * subrow.siteWidth;
-
-                        // 檢查是否超出子行範圍
-                        if (alignedX + block->width > subrow.xEnd + 1e-6) {
-                            continue; // 放置後會超出子行範圍，則嘗試下一個位置
-                        }
-
-                        // 放置模組
-                        block->x = alignedX;
-                        block->y = row.yStart;
-                        subrow.insertBlock(block, startSite, sitesNeeded); // 更新已放置模組列表和站點佔用狀態
-
-                        placed = true;
-                        // 除錯輸出
-                        // cout << "模組 " << block->name << " 被放置於行 " << idx << " 的子行 " << subIdx << "，站點起始索引：" << startSite << endl;
-                        break; // 模組已放置跳出循環
-                    }
-                }
+                // 由空閒摘要直接找出最左側的連續可用站點(整數站點範圍保證不超出子行)
+                int startSite = subrow.freeSites.firstFit(sitesNeeded, 0, subrow.numSites - sitesNeeded);
+                if (startSite >= 0) {
+                    // 放置模組並更新已放置模組列表、站點佔用狀態與行層級摘要
+                    placeBlock(placement, block, static_cast<int>(idx), static_cast<int>(subIdx), startSite, sitesNeeded);
 
-                if (placed) {
+                    placed = true;
+                    // 除錯輸出
+                    // cout << "模組 " << block->name << " 被放置於行 " << idx << " 的子行 " << subIdx << "，站點起始索引：" << startSite << endl;
                     break; // 模組已放置跳出循環
                 }
             }
@@ -505,196 +1666,533 @@ void initialPlacement(Placement& placement) {
             }
         }
 
-        if (!placed) {
-            cerr << "錯誤：無法找到足夠的空間放置模組 " << block->name << endl;
+        // 串流模式的視窗只涵蓋部分行，放不下的模組留待視窗上移後再試，不在此輸出錯誤
+        if (!placed && placement.rowBegin == 0 && placement.rowEnd == placement.rows.size()) {
+            cerr << "錯誤：無法找到足夠的空間放置模組 " << block->name
+                << "(剩餘空閒站點：" << rowFree.freeSites(begin, end - 1) << ")" << endl;
             // 繼續嘗試放置其他模組
             // exit(1);
         }
     }
 }
 
+// 在原始位置周圍的曼哈頓距離內(且位於 window 內)為模組尋找位移更小的位置
+// 找到時移動模組並回傳減少的位移(定點站點單位)，否則回傳 0；搜尋範圍與比較全部以整數計算
+template <class Geometry>
+long long improveBlockImpl(Placement& placement, const Geometry& geometry, Block* block, const MoveWindow& window) {
+    // 保存當前位移距離
+    long long originalDisp = blockDisplacement(placement, *block);
+
+    // 尋找最佳位置僅在原始位置周圍的曼哈頓距離內搜尋
+    int bestRowIdx = -1;
+    int bestSubRowIdx = -1;
+    int bestSite = -1;
+    long long bestDisp = originalDisp;
+
+    // 動態計算最大曼哈頓距離
+    long long maxManhattanDist = originalDisp + placement.searchMargin; // 搜尋範圍
+    long long width = block->widthSites * siteUnit;
+    size_t firstRow, lastRow;
+    geometry.rowRange(placement, max(block->origY - maxManhattanDist, window.yLo),
+        min(block->origY + maxManhattanDist, window.yHi), firstRow, lastRow);
+    // 以行層級摘要跳過整段沒有足夠連續空閒空間的行
+    long lastRank = static_cast<long>(lastRow) - 1;
+    for (long rank = placement.rowFree.nextFit(static_cast<long>(firstRow), lastRank, width); rank >= 0;
+        rank = placement.rowFree.nextFit(rank + 1, lastRank, width)) {
+        size_t rowIdx = placement.rowOrder[rank];
+        Row& row = placement.rows[rowIdx];
+
+        // 計算垂直距離
+        long long verticalDist = llabs(row.yUnits - block->origY);
+        if (verticalDist > maxManhattanDist || row.yUnits < window.yLo || row.yUnits > window.yHi) {
+            continue; // 超出最大垂直距離或限制範圍
+        }
+
+        // 模組需要的站點數(已預先計算)
+        int sitesNeeded = geometry.sitesNeeded(block, row);
+
+        // 計算允許的水平距離
+        long long remainingDist = maxManhattanDist - verticalDist;
+
+        // 計算水平範圍(再與限制範圍取交集)
+        long long minX = max(block->origX - remainingDist, window.xLo);
+        long long maxXPos = min(block->origX + remainingDist, window.xHi);
+
+        // 確認模組高度是否適合
+        if (!geometry.fits(block, row)) {
+            continue; // 模組太高
+        }
+
+        for (size_t subIdx = 0; subIdx < row.subRows.size(); ++subIdx) {
+            SubRow& subrow = row.subRows[subIdx];
+            if (subrow.freeSites.longest() < sitesNeeded) {
+                continue;
+            }
+            // 候選站點範圍：模組左端不小於 minX、右端不大於 maxXPos(基準站點寬度只需位移)
+            long long siteUnits = geometry.siteUnits(subrow);
+            long long minSite = max(geometry.ceilSites(subrow, minX - subrow.xUnits), 0LL);
+            long long maxSite = min(geometry.floorSites(subrow, maxXPos - subrow.xUnits) - sitesNeeded,
+                static_cast<long long>(subrow.numSites - sitesNeeded));
+            if (minSite > maxSite) {
+                continue;
+            }
+
+            // 位移對站點是凸函數：只需比較原始位置左側最近與右側最近的可用站點(左側優先)
+            long long targetSite = min(max(geometry.floorSites(subrow, block->origX - subrow.xUnits), minSite - 1), maxSite);
+            int candidates[2] = {
+                subrow.freeSites.lastFit(sitesNeeded, static_cast<int>(minSite), static_cast<int>(targetSite)),
+                subrow.freeSites.firstFit(sitesNeeded, static_cast<int>(targetSite + 1), static_cast<int>(maxSite))
+            };
+            for (int siteIdx : candidates) {
+                if (siteIdx < 0) {
+                    continue;
+                }
+                // 計算新的曼哈頓距離，只有嚴格更小才記錄(整數比較沒有誤差)
+                long long newDisp = llabs(subrow.xUnits + siteIdx * siteUnits - block->origX) + verticalDist;
+                if (newDisp < bestDisp) {
+                    bestDisp = newDisp;
+                    bestRowIdx = static_cast<int>(rowIdx);
+                    bestSubRowIdx = static_cast<int>(subIdx);
+                    bestSite = siteIdx;
+                }
+            }
+        }
+    }
+
+    // 如果找到更好的位置則更新模組位置
+    if (bestRowIdx >= 0) {
+        // 直接依整數座標從原子行移除模組，再放置到新位置的子行中
+        unplaceBlock(placement, block, geometry.sitesNeeded(block, placement.rows[block->rowIdx]));
+        placeBlock(placement, block, bestRowIdx, bestSubRowIdx, bestSite, geometry.sitesNeeded(block, placement.rows[bestRowIdx]));
+        // 除錯輸出
+        // cout << "模組 " << block->name << " 被放置於行 " << bestRowIdx << " 的子行 " << bestSubRowIdx << "，站點起始索引：" << bestSite << endl;
+
+        return originalDisp - bestDisp;
+    }
+    return 0;
+}
+
 // 二次擺放優化
-void optimizePlacement(Placement& placement) {
+template <class Geometry>
+void optimizePlacementImpl(Placement& placement, const Geometry& geometry, const TimeBudget& budget) {
     bool improvement = true; // 避免無限迴圈
     int maxIterations = 6;    // 最大迭代次數
     int currentIteration = 0;
+    bool timeUp = false;      // 時間預算是否用完
 
-    while (improvement && currentIteration < maxIterations) {
+    // 每次移動都保持合法且只會縮短位移，因此當前結果即為目前最佳結果
+    double maxDisplacement = 0.0;
+    double totalDisplacement = calculateTotalDisplacement(placement, maxDisplacement);
+    double nextLog = budget.logInterval;
+
+    while (improvement && currentIteration < maxIterations && !timeUp) {
         improvement = false;
         currentIteration++;
 
-        // 收集可移動的模組
-        vector<Block*> movableBlocks;
+        // 收集可移動的模組及其當前曼哈頓距離
+        vector<pair<long long, Block*>> movableBlocks;
         for (auto& kv : placement.blocks) {
             if (!kv.second.isFixed) {
-                movableBlocks.push_back(&kv.second);
+                movableBlocks.emplace_back(blockDisplacement(placement, kv.second), &kv.second);
             }
         }
-        // 按照模組的當前曼哈頓距離從大到小排序
-        sort(movableBlocks.begin(), movableBlocks.end(), [&](Block* a, Block* b) {
-            double dispA = abs(a->x - a->origX) + abs(a->y - a->origY);
-            double dispB = abs(b->x - b->origX) + abs(b->y - b->origY);
-            return dispA > dispB;
+        // 按照模組的當前曼哈頓距離從大到小排序(可能獲益最大的模組優先)
+        sort(movableBlocks.begin(), movableBlocks.end(), [](const pair<long long, Block*>& a, const pair<long long, Block*>& b) {
+            return a.first > b.first;
         });
 
-        for (auto& block : movableBlocks) {
-            // 保存當前位移距離
-            double originalDisp = abs(block->x - block->origX) + abs(block->y - block->origY);
-
-            // 尋找最佳位置僅在原始位置周圍的曼哈頓距離內搜尋
-            size_t bestRowIdx = placement.rows.size();
-            double bestX = block->x;
-            double bestY = block->y;
-            double bestDisp = originalDisp;
-
-            // 動態計算最大曼哈頓距離
-            double maxManhattanDist = originalDisp + 20.0; // 搜尋範圍
-            for (size_t rowIdx = 0; rowIdx < placement.rows.size(); ++rowIdx) {
-                Row& row = placement.rows[rowIdx];
-
-                // 計算垂直距離
-                double verticalDist = abs(row.yStart - block->origY);
-                if (verticalDist > maxManhattanDist) {
-                    continue; // 超出最大垂直距離
-                }
-
-                // 計算模組需要的站點數向上取整
-                int sitesNeeded = ceil(block->width / row.siteWidth);
-
-                // 計算允許的水平距離
-                double remainingDist = maxManhattanDist - verticalDist;
-                if (remainingDist < 0) {
-                    continue; // 無法在此行放置
-                }
-
-                // 計算水平範圍
-                double minX = block->origX - remainingDist;
-                double maxXPos = block->origX + remainingDist;
-
-                // 確認模組高度是否適合
-                if (block->height > row.height + 1e-6) {
-                    continue; // 模組太高無法放入此行
-                }
-
-                for (auto& subrow : row.subRows) {
-                    // 計算候選站點範圍
-                    int minSite = static_cast<int>(floor((minX - subrow.xStart) / subrow.siteWidth + 1e-6));
-                    int maxSite = static_cast<int>(floor((maxXPos - subrow.xStart - block->width) / subrow.siteWidth + 1e-6));
-                    minSite = max(minSite, 0);
-                    maxSite = min(maxSite, subrow.numSites - sitesNeeded);
-
-                    for(int siteIdx = minSite; siteIdx <= maxSite; ++siteIdx){
-                        if(subrow.canPlaceAt(siteIdx, sitesNeeded)){
-                            // 計算對齊後的 x 座標
-                            double candidateX = subrow.xStart + siteIdx * subrow.siteWidth;
-
-                            // 檢查是否超出子行範圍
-                            if (candidateX + block->width > subrow.xEnd + 1e-6) {
-                                continue; // 放置後會超出子行範圍
-                            }
-
-                            // 計算新的曼哈頓距離
-                            double newDisp = abs(candidateX - block->origX) + abs(row.yStart - block->origY);
-                            // 如果新的距離更小，則記錄下來
-                            if (newDisp < bestDisp - 1e-6) { // 使用一個小的閾值避免浮點數誤差
-                                bestDisp = newDisp;
-                                bestRowIdx = rowIdx;
-                                bestX = candidateX;
-                                bestY = row.yStart;
-                            }
-                        }
-                    }
+        for (auto& entry : movableBlocks) {
+            // 每個模組前檢查時間預算
+            if (budget.limit > 0.0 || budget.logInterval > 0.0) {
+                double elapsed = budget.elapsed();
+                if (budget.logInterval > 0.0 && elapsed >= nextLog) {
+                    cout << fixed << setprecision(4) << "[" << elapsed << "s] pass " << currentIteration
+                        << " total displacement: " << totalDisplacement << endl;
+                    nextLog = elapsed + budget.logInterval;
+                }
+                if (budget.limit > 0.0 && elapsed >= budget.limit) {
+                    timeUp = true;
+                    break;
                 }
             }
+            Block* block = entry.second;
+            if (block->rowIdx < 0) {
+                continue; // 未放置的模組無法移動
+            }
+            long long gain = improveBlockImpl(placement, geometry, block, MoveWindow());
+            if (gain > 0) {
+                totalDisplacement -= fromSiteUnits(gain, placement.siteWidth);
+                improvement = true;
+            }
+        }
+    }
 
-            // 如果找到更好的位置則更新模組位置
-            if (bestDisp < originalDisp - 1e-6) { // 使用一個小的閾值避免浮點數誤差
-                // 找到當前模組所在的行和子行，並從中移除模組
-                bool removed = false;
-                for (size_t rowIdx = 0; rowIdx < placement.rows.size(); ++rowIdx) {
-                    Row& row = placement.rows[rowIdx];
-                    if (fabs(row.yStart - block->y) < 1e-6) { // 使用 fabs 比較浮點數
-                        for (size_t subIdx = 0; subIdx < row.subRows.size(); ++subIdx) {
-                            SubRow& subrow = row.subRows[subIdx];
-                            // 計算模組所在的站點
-                            int startSite = static_cast<int>(floor((block->x - subrow.xStart) / subrow.siteWidth + 1e-6));
-                            int sitesOccupied = ceil(block->width / subrow.siteWidth);
-                            // 檢查模組是否在此子行範圍內
-                            if (block->x >= subrow.xStart - 1e-6 && block->x + block->width <= subrow.xEnd + 1e-6) {
-                                if (startSite >=0 && startSite < subrow.numSites && subrow.occupiedSites[startSite]) { // 確保模組被標記為佔用
-                                    subrow.removeBlock(block, startSite, sitesOccupied);
-                                    // 除錯輸出
-                                    // cout << "模組 " << block->name << " 從行 " << rowIdx << " 的子行 " << subIdx << " 移除。" << endl;
-                                    removed = true;
-                                    break;
-                                }
-                            }
-                        }
-                        if (removed) break;
-                    }
-                }
+    if (budget.logInterval > 0.0) {
+        cout << fixed << setprecision(4) << "[" << budget.elapsed() << "s] "
+            << (timeUp ? "time limit reached" : "optimization finished") << " after pass " << currentIteration
+            << ", total displacement: " << totalDisplacement << endl;
+    }
+}
 
-                if (!removed) {
-                    cerr << "錯誤：模組 " << block->name << " 未能從原位置正確移除。" << endl;
-                    continue; // 跳過這個模組，避免錯誤
-                }
-
-                // 更新模組位置
-                block->x = bestX;
-                block->y = bestY;
-
-                // 模組放置到新位置的子行中
-                Row& newRow = placement.rows[bestRowIdx];
-                bool placed = false;
-                for (size_t subIdx = 0; subIdx < newRow.subRows.size(); ++subIdx) {
-                    SubRow& subrow = newRow.subRows[subIdx];
-                    if (block->x >= subrow.xStart - 1e-6 && block->x + block->width <= subrow.xEnd + 1e-6) {
-                        // 計算要放置的索引
-                        int startSite = static_cast<int>(floor((block->x - subrow.xStart) / subrow.siteWidth + 1e-6));
-                        int sitesNeeded = ceil(block->width / subrow.siteWidth);
-                        if(subrow.canPlaceAt(startSite, sitesNeeded)){
-                            subrow.insertBlock(block, startSite, sitesNeeded);
-                            // 除錯輸出
-                            // cout << "模組 " << block->name << " 被放置於行 " << bestRowIdx << " 的子行 " << subIdx << "，站點起始索引：" << startSite << endl;
-                            placed = true;
-                            break;
-                        }
-                    }
+// Tetris式掃描放置：模組依X排序一次，每個子行維護前緣(前緣右側全部空閒)
+// 每個模組只考慮最近的 nearRows 行，放在使位移最小的子行前緣位置；最近的行都放不下時才向外擴大
+template <class Geometry>
+void sweepPlacementImpl(Placement& placement, const Geometry& geometry, int nearRows) {
+    vector<Block*> movableBlocks; // 收集尚未放置的可移動模組
+    for (auto& kv : placement.blocks) {
+        if (!kv.second.isFixed && kv.second.rowIdx < 0) {
+            movableBlocks.push_back(&kv.second);
+        }
+    }
+
+    // 按照模組的原始位置排序，從左到右
+    sort(movableBlocks.begin(), movableBlocks.end(), [](Block* a, Block* b) {
+        if (a->origX != b->origX)
+            return a->origX < b->origX;
+        return a->origY < b->origY;
+    });
+
+    // 可使用的行依Y座標排序(rank 範圍即可使用的行)
+    vector<Row>& rows = placement.rows;
+    vector<size_t> rowOrder(placement.rowOrder.begin() + placement.rowBegin, placement.rowOrder.begin() + placement.rowEnd);
+
+    // 子行前緣：最後一個已放置模組的右端
+    vector<vector<int>> frontier(rows.size());
+    for (size_t r : rowOrder) {
+        frontier[r].resize(rows[r].subRows.size(), 0);
+        for (size_t subIdx = 0; subIdx < rows[r].subRows.size(); ++subIdx) {
+            const SubRow& subrow = rows[r].subRows[subIdx];
+            if (!subrow.placedBlocks.empty()) {
+                const Block* last = subrow.placedBlocks.back();
+                frontier[r][subIdx] = last->site + geometry.sitesNeeded(last, rows[r]);
+            }
+        }
+    }
+
+    for (auto& block : movableBlocks) {
+        int bestRowIdx = -1;
+        int bestSubRowIdx = -1;
+        int bestSite = -1;
+        long long bestDisp = numeric_limits<long long>::max();
+
+        // 由最近的行向兩側展開
+        long n = static_cast<long>(rowOrder.size());
+        long above = lower_bound(rowOrder.begin(), rowOrder.end(), block->origY, [&](size_t r, long long y) {
+            return rows[r].yUnits < y;
+        }) - rowOrder.begin();
+        long below = above - 1;
+        int visited = 0;
+        while ((visited < nearRows || bestRowIdx < 0) && (below >= 0 || above < n)) {
+            size_t r;
+            if (above >= n || (below >= 0 && block->origY - rows[rowOrder[below]].yUnits <= rows[rowOrder[above]].yUnits - block->origY)) {
+                r = rowOrder[below--];
+            }
+            else {
+                r = rowOrder[above++];
+            }
+            ++visited;
+
+            Row& row = rows[r];
+            long long verticalDist = llabs(row.yUnits - block->origY);
+            if (verticalDist >= bestDisp) {
+                break; // 更遠的行不可能更好
+            }
+            if (!geometry.fits(block, row)) {
+                continue; // 模組太高，無法放入此行
+            }
+            int sitesNeeded = geometry.sitesNeeded(block, row);
+            for (size_t subIdx = 0; subIdx < row.subRows.size(); ++subIdx) {
+                const SubRow& subrow = row.subRows[subIdx];
+                long long siteUnits = geometry.siteUnits(subrow);
+                // 放在原始位置最近的站點，若已被前緣越過則緊接在前緣之後
+                long long targetSite = geometry.floorSites(subrow, block->origX - subrow.xUnits + siteUnits / 2);
+                int site = static_cast<int>(max(static_cast<long long>(frontier[r][subIdx]), min(targetSite, static_cast<long long>(subrow.numSites))));
+                if (site + sitesNeeded > subrow.numSites) {
+                    continue; // 子行剩餘空間不足
                 }
-                if (!placed) {
-                    cerr << "錯誤：模組 " << block->name << " 在優化後無法正確放置。" << endl;
-                    // 可以選擇重新放置或其他處理方式
-                    continue;
+                long long newDisp = llabs(subrow.xUnits + site * siteUnits - block->origX) + verticalDist;
+                if (newDisp < bestDisp) {
+                    bestDisp = newDisp;
+                    bestRowIdx = static_cast<int>(r);
+                    bestSubRowIdx = static_cast<int>(subIdx);
+                    bestSite = site;
                 }
+            }
+        }
 
+        if (bestRowIdx >= 0) {
+            int sitesNeeded = geometry.sitesNeeded(block, rows[bestRowIdx]);
+            placeBlock(placement, block, bestRowIdx, bestSubRowIdx, bestSite, sitesNeeded);
+            frontier[bestRowIdx][bestSubRowIdx] = bestSite + sitesNeeded;
+        }
+        // 放不下的模組留給最先適配放置處理
+    }
+}
+
+// 局部細化：只移動指定的模組，且每個模組只在自己的限制範圍內尋找位移更小的位置
+template <class Geometry>
+void refinePlacementImpl(Placement& placement, const Geometry& geometry,
+    vector<pair<Block*, MoveWindow>>& cells, const TimeBudget& budget) {
+    const int maxIterations = 2; // 鄰域很小，兩輪即大致收斂
+
+    // 按照模組展開後的曼哈頓距離從大到小排序
+    vector<pair<long long, size_t>> order;
+    order.reserve(cells.size());
+    for (size_t i = 0; i < cells.size(); ++i) {
+        order.emplace_back(blockDisplacement(placement, *cells[i].first), i);
+    }
+    sort(order.begin(), order.end(), [](const pair<long long, size_t>& a, const pair<long long, size_t>& b) {
+        return a.first > b.first;
+    });
+
+    bool improvement = true;
+    for (int iteration = 0; iteration < maxIterations && improvement; ++iteration) {
+        improvement = false;
+        for (const auto& entry : order) {
+            if (budget.expired()) {
+                return; // 時間預算用完，目前的佈局仍合法
+            }
+            Block* block = cells[entry.second].first;
+            if (block->rowIdx < 0) {
+                continue; // 未放置的模組無法移動
+            }
+            if (improveBlockImpl(placement, geometry, block, cells[entry.second].second) > 0) {
                 improvement = true;
             }
         }
     }
 }
 
-//計算總移動距離
+// 依行幾何選擇特化版本
+void initialPlacement(Placement& placement) {
+    withGeometry(placement, [&](const auto& geometry) {
+        initialPlacementImpl(placement, geometry);
+    });
+}
+
+void sweepPlacement(Placement& placement, int nearRows) {
+    withGeometry(placement, [&](const auto& geometry) {
+        sweepPlacementImpl(placement, geometry, nearRows);
+    });
+}
+
+// 初始合法化：掃描引擎先放置，剩下的模組(或全部)再以最先適配放置
+void runInitialPlacement(Placement& placement, const Options& options) {
+    if (options.engine == PlacementEngine::Sweep) {
+        sweepPlacement(placement, options.sweepRows);
+    }
+    initialPlacement(placement);
+}
+
+void optimizePlacement(Placement& placement, const TimeBudget& budget) {
+    withGeometry(placement, [&](const auto& geometry) {
+        optimizePlacementImpl(placement, geometry, budget);
+    });
+}
+
+void refinePlacement(Placement& placement, vector<pair<Block*, MoveWindow>>& cells, const TimeBudget& budget) {
+    withGeometry(placement, [&](const auto& geometry) {
+        refinePlacementImpl(placement, geometry, cells, budget);
+    });
+}
+
+//計算總移動距離(原始單位)
 double calculateTotalDisplacement(const Placement& placement, double& maxDisplacement) {
     double totalDisplacement = 0.0;
-    maxDisplacement = 0.0;
+    long long maxUnits = 0;
     for (const auto& kv : placement.blocks) {
         const Block& block = kv.second;
         if (!block.isFixed) {
-            double dx = abs(block.x - block.origX);
-            double dy = abs(block.y - block.origY);
-            double displacement = dx + dy; // 曼哈頓距離
-            totalDisplacement += displacement;
-            if (displacement > maxDisplacement) {
-                maxDisplacement = displacement;
-            }
+            long long displacement = blockDisplacement(placement, block); // 曼哈頓距離
+            totalDisplacement += fromSiteUnits(displacement, placement.siteWidth);
+            maxUnits = max(maxUnits, displacement);
         }
     }
+    maxDisplacement = fromSiteUnits(maxUnits, placement.siteWidth);
     return totalDisplacement;
 }
 
+// 粗化：模組依最近的行分組並依X排序，間隙不大於兩者較窄寬度的相鄰模組兩兩合併為超級模組
+// 成員在超級模組內依站點緊密相連；原始X取各成員扣除偏移後的平均，原始Y取平均
+size_t coarsenLevel(const Placement& placement, const unordered_map<string, Block>& fine, CoarseLevel& coarse, int level) {
+    const vector<Row>& rows = placement.rows;
+    coarse.blocks.clear();
+    coarse.members.clear();
+
+    vector<vector<const Block*>> buckets(rows.size());
+    for (const auto& kv : fine) {
+        if (kv.second.isFixed || rows.empty()) {
+            coarse.blocks.emplace(kv.first, kv.second); // 固定模組不參與合併
+        }
+        else {
+            buckets[nearestRowIndex(placement, kv.second.origY)].push_back(&kv.second);
+        }
+    }
+
+    size_t merged = 0;
+    for (size_t r = 0; r < rows.size(); ++r) {
+        vector<const Block*>& bucket = buckets[r];
+        sort(bucket.begin(), bucket.end(), [](const Block* a, const Block* b) {
+            if (a->origX != b->origX)
+                return a->origX < b->origX;
+            return a->name < b->name;
+        });
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            const Block* a = bucket[i];
+            const Block* b = i + 1 < bucket.size() ? bucket[i + 1] : nullptr;
+            if (b == nullptr || a->fitClass > rows[r].heightClass || b->fitClass > rows[r].heightClass ||
+                b->origX - (a->origX + a->widthSites * siteUnit) > min(a->widthSites, b->widthSites) * siteUnit) {
+                coarse.blocks.emplace(a->name, *a); // 不合併，沿用原模組
+                continue;
+            }
+            Block super;
+            super.name = "$ml" + to_string(level) + "_" + to_string(merged);
+            super.widthSites = a->widthSites + b->widthSites;
+            super.fitClass = max(a->fitClass, b->fitClass);
+            super.origX = floorDiv(a->origX + b->origX - a->widthSites * siteUnit, 2);
+            super.origY = floorDiv(a->origY + b->origY, 2);
+            coarse.members[super.name] = { a->name, b->name };
+            coarse.blocks.emplace(super.name, super);
+            ++merged;
+            ++i;
+        }
+    }
+    return merged;
+}
+
+// 展開：未合併的模組沿用粗層的位置，超級模組的成員從其起始站點依序緊接放置，並重建站點佔用
+// 成員的細化範圍為超級模組向左右各擴展一個超級模組寬度、上下各兩行；放不下的成員留待重新放置
+void uncoarsenLevel(Placement& placement, const CoarseLevel& coarse, unordered_map<string, Block>& fine,
+    vector<pair<Block*, MoveWindow>>& refineCells) {
+    vector<Block*> placed;
+    for (const auto& kv : coarse.blocks) {
+        const Block& superBlock = kv.second;
+        if (superBlock.isFixed) {
+            continue;
+        }
+        auto it = coarse.members.find(kv.first);
+        if (it == coarse.members.end()) {
+            Block& block = fine[kv.first];
+            block.rowIdx = superBlock.rowIdx;
+            block.subRowIdx = superBlock.subRowIdx;
+            block.site = superBlock.site;
+            if (block.rowIdx >= 0) {
+                placed.push_back(&block);
+            }
+            continue;
+        }
+        if (superBlock.rowIdx < 0) {
+            continue; // 超級模組未放置，成員稍後以最先適配放置
+        }
+        const Row& row = placement.rows[superBlock.rowIdx];
+        long long x = blockXUnits(placement, superBlock);
+        long long width = superBlock.widthSites * siteUnit;
+        MoveWindow window(x - width, x + 2 * width, row.yUnits - 2 * row.heightUnits, row.yUnits + 2 * row.heightUnits);
+        int site = superBlock.site;
+        for (const string& name : it->second) {
+            Block& block = fine[name];
+            block.rowIdx = superBlock.rowIdx;
+            block.subRowIdx = superBlock.subRowIdx;
+            block.site = site;
+            site += sitesNeededIn(&block, row);
+            placed.push_back(&block);
+            refineCells.emplace_back(&block, window);
+        }
+    }
+
+    // 清空站點佔用後依位置順序重新插入，已放置列表只需在尾端追加
+    for (size_t r = 0; r < placement.rows.size(); ++r) {
+        activateRow(placement, r);
+    }
+    sort(placed.begin(), placed.end(), [](const Block* a, const Block* b) {
+        if (a->rowIdx != b->rowIdx)
+            return a->rowIdx < b->rowIdx;
+        if (a->subRowIdx != b->subRowIdx)
+            return a->subRowIdx < b->subRowIdx;
+        return a->site < b->site;
+    });
+    for (Block* block : placed) {
+        const Row& row = placement.rows[block->rowIdx];
+        SubRow& subrow = placement.rows[block->rowIdx].subRows[block->subRowIdx];
+        int sitesNeeded = sitesNeededIn(block, row);
+        if (subrow.canPlaceAt(block->site, sitesNeeded)) {
+            subrow.insertBlock(block, block->site, sitesNeeded);
+        }
+        else {
+            // 非基準站點寬度的行中成員可能比超級模組寬
+            block->rowIdx = -1;
+            block->subRowIdx = -1;
+            block->site = -1;
+        }
+    }
+    // 重新插入完成後一次更新行層級摘要
+    for (size_t r = 0; r < placement.rows.size(); ++r) {
+        refreshRowSummary(placement, r);
+    }
+}
+
+// 多層級合法化：逐層粗化，以既有引擎合法化最粗層，再逐層展開並只在超級模組的鄰域內細化
+// 每層輸出執行時間與該層模組的總位移、最大位移
+void multilevelPlacement(Placement& placement, const Options& options, const TimeBudget& budget) {
+    // levels[0] 為原始模組，levels[k] 由 levels[k-1] 粗化而來
+    vector<CoarseLevel> levels(1);
+    levels[0].blocks.swap(placement.blocks);
+    double start = budget.elapsed();
+    for (int level = 1; level <= options.multilevel; ++level) {
+        CoarseLevel coarse;
+        if (coarsenLevel(placement, levels.back().blocks, coarse, level) == 0) {
+            break; // 已沒有可合併的模組
+        }
+        levels.push_back(move(coarse));
+    }
+    cout << fixed << setprecision(4);
+    cout << "Coarsening: " << levels.size() - 1 << " levels, " << budget.elapsed() - start << "s" << endl;
+
+    auto report = [&](size_t level, double levelStart) {
+        size_t cells = 0;
+        for (const auto& kv : placement.blocks) {
+            cells += kv.second.isFixed ? 0 : 1;
+        }
+        double maxDisplacement = 0.0;
+        double totalDisplacement = calculateTotalDisplacement(placement, maxDisplacement);
+        cout << "Level " << level << " (" << cells << " cells): " << budget.elapsed() - levelStart
+            << "s, total displacement: " << totalDisplacement << ", maximum displacement: " << maxDisplacement << endl;
+    };
+
+    // 最粗層以既有引擎合法化與優化
+    size_t top = levels.size() - 1;
+    start = budget.elapsed();
+    placement.blocks.swap(levels[top].blocks);
+    runInitialPlacement(placement, options);
+    optimizePlacement(placement, budget);
+    report(top, start);
+
+    // 逐層展開並細化
+    for (size_t level = top; level > 0; --level) {
+        start = budget.elapsed();
+        vector<pair<Block*, MoveWindow>> refineCells;
+        placement.blocks.swap(levels[level].blocks);
+        uncoarsenLevel(placement, levels[level], levels[level - 1].blocks, refineCells);
+        placement.blocks.swap(levels[level - 1].blocks); // 換入較細的一層
+        levels.pop_back();                               // 釋放粗層模組
+        initialPlacement(placement); // 展開後放不下的模組
+        refinePlacement(placement, refineCells, budget);
+        report(level - 1, start);
+    }
+}
+
+//關閉輸出檔，寫入失敗(例如磁碟已滿)時刪除不完整的檔案並結束程式
+void closeOutputFile(OutputFile& outfile, const string& filename) {
+    if (!outfile.close()) {
+        cerr << "錯誤：寫入檔案失敗：" << filename << endl;
+        remove(filename.c_str());
+        exit(1);
+    }
+}
+
 //輸出 .pl 檔案
-void writePlFile(const string& filename, const Placement& placement) {
-    ofstream outfile(filename);
+void writePlFile(const string& filename, const Placement& placement, Compression compression) {
+    OutputFile outfile(filename, compression);
     if (!outfile) {
         cerr << "無法寫入 .pl 檔案：" << filename << endl;
         exit(1);
@@ -703,17 +2201,18 @@ void writePlFile(const string& filename, const Placement& placement) {
     outfile << fixed << setprecision(6); // 設置輸出精度
     for (const auto& kv : placement.blocks) {
         const Block& block = kv.second;
-        outfile << block.name << " " << block.x << " " << block.y;
+        outfile << block.name << " " << blockX(placement, block) << " " << blockY(placement, block);
         /*if (block.isFixed) {
             outfile << " /FIXED";
         }*/
         outfile << "\n";
     }
+    closeOutputFile(outfile, filename);
 }
 
 //輸出 .nodes 檔案
-void writeNodesFile(const string& filename, const unordered_map<string, Node>& nodes) {
-    ofstream outfile(filename);
+void writeNodesFile(const string& filename, const unordered_map<string, Node>& nodes, Compression compression) {
+    OutputFile outfile(filename, compression);
     if (!outfile) {
         cerr << "無法寫入 .nodes 檔案：" << filename << endl;
         exit(1);
@@ -735,11 +2234,12 @@ void writeNodesFile(const string& filename, const unordered_map<string, Node>& n
         }
         outfile << "\n";
     }
+    closeOutputFile(outfile, filename);
 }
 
 //輸出 .scl 檔案
-void writeSclFile(const string& filename, const vector<Row>& rows) {
-    ofstream outfile(filename);
+void writeSclFile(const string& filename, const vector<Row>& rows, Compression compression) {
+    OutputFile outfile(filename, compression);
     if (!outfile) {
         cerr << "無法寫入 .scl 檔案：" << filename << endl;
         exit(1);
@@ -760,50 +2260,1116 @@ void writeSclFile(const string& filename, const vector<Row>& rows) {
         }
         outfile << "End\n\n";
     }
+    closeOutputFile(outfile, filename);
 }
 
 //輸出 .aux 檔案
-void writeAuxFile(const string& filename, const string& outputFilePrefix) {
+void writeAuxFile(const string& filename, const string& outputFilePrefix, const string& suffix) {
     ofstream outfile(filename);
     if (!outfile) {
         cerr << "無法寫入 .aux 檔案：" << filename << endl;
         exit(1);
     }
-    outfile << "RowBasedPlacement : " << outputFilePrefix << ".nodes "
-        << outputFilePrefix << ".nets "
-        << outputFilePrefix << ".wts "
-        << outputFilePrefix << ".pl "
-        << outputFilePrefix << ".scl\n";
+    outfile << "RowBasedPlacement : " << outputFilePrefix << ".nodes" << suffix << " "
+        << outputFilePrefix << ".nets" << suffix << " "
+        << outputFilePrefix << ".wts" << suffix << " "
+        << outputFilePrefix << ".pl" << suffix << " "
+        << outputFilePrefix << ".scl" << suffix << "\n";
 }
 
-//複製檔案
-void copyFile(const string& srcFilename, const string& destFilename) {
-    ifstream src(srcFilename, ios::binary);
+//複製檔案(來源可為壓縮檔，目的依指定格式壓縮)
+void copyFile(const string& srcFilename, const string& destFilename, Compression compression) {
+    InputFile src(srcFilename);
     if (!src) {
         cerr << "錯誤：無法打開來源檔案：" << srcFilename << endl;
         exit(1);
     }
-    ofstream dest(destFilename, ios::binary);
+    OutputFile dest(destFilename, compression);
     if (!dest) {
         cerr << "錯誤：無法打開目的檔案：" << destFilename << endl;
         exit(1);
     }
     dest << src.rdbuf();
+    closeOutputFile(dest, destFilename);
+}
+
+// 外部排序：分塊排序後寫出暫存檔，再以多路合併輸出，記憶體只需容納一個分塊
+void externalSort(const string& inPath, const string& outPath, size_t chunkLines,
+    const function<bool(const string&, const string&)>& less) {
+    ifstream infile(inPath);
+    if (!infile) {
+        cerr << "錯誤：無法打開排序輸入檔案：" << inPath << endl;
+        exit(1);
+    }
+    vector<string> runFiles;
+    vector<string> lines;
+    auto writeRun = [&]() {
+        if (lines.empty()) return;
+        stable_sort(lines.begin(), lines.end(), less);
+        string runFile = outPath + ".run" + to_string(runFiles.size());
+        ofstream run(runFile);
+        if (!run) {
+            cerr << "錯誤：無法寫入排序暫存檔案：" << runFile << endl;
+            exit(1);
+        }
+        for (const auto& l : lines) {
+            run << l << '\n';
+        }
+        runFiles.push_back(runFile);
+        lines.clear();
+    };
+    string line;
+    while (getline(infile, line)) {
+        lines.push_back(line);
+        if (lines.size() >= chunkLines) {
+            writeRun();
+        }
+    }
+    writeRun();
+    vector<string>().swap(lines);
+
+    // 多路合併，相同鍵值依分塊順序輸出以保持穩定
+    ofstream outfile(outPath);
+    if (!outfile) {
+        cerr << "錯誤：無法寫入排序輸出檔案：" << outPath << endl;
+        exit(1);
+    }
+    vector<unique_ptr<ifstream>> runs;
+    vector<string> heads(runFiles.size());
+    auto later = [&](size_t a, size_t b) {
+        if (less(heads[b], heads[a])) return true;
+        if (less(heads[a], heads[b])) return false;
+        return a > b;
+    };
+    priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+    for (size_t i = 0; i < runFiles.size(); ++i) {
+        runs.emplace_back(new ifstream(runFiles[i]));
+        if (getline(*runs[i], heads[i])) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        outfile << heads[i] << '\n';
+        if (getline(*runs[i], heads[i])) {
+            heap.push(i);
+        }
+    }
+    runs.clear();
+    for (const auto& runFile : runFiles) {
+        remove(runFile.c_str());
+    }
+}
+
+
+// 最接近y的行索引：在依Y排序的 rowOrder 上二分搜尋，.scl 中的行不需依Y排列
+size_t nearestRowIndex(const Placement& placement, long long y) {
+    const vector<Row>& rows = placement.rows;
+    const vector<size_t>& order = placement.rowOrder;
+    auto it = lower_bound(order.begin(), order.end(), y, [&](size_t r, long long v) {
+        return rows[r].yUnits < v;
+    });
+    size_t k = static_cast<size_t>(it - order.begin());
+    if (k == order.size()) {
+        return order.back();
+    }
+    if (k > 0 && y - rows[order[k - 1]].yUnits <= rows[order[k]].yUnits - y) {
+        return order[k - 1];
+    }
+    return order[k];
+}
+
+// 串流合法化：以外部排序依Y排序模組，逐帶狀區放置，只保留滑動視窗內的行與模組
+// 所有模組都放置時回傳 true
+bool streamLegalize(const unordered_map<string, string>& files, const string& outputFile,
+    Placement& placement, const Options& options, const TimeBudget& budget,
+    double& totalDisplacement, double& maxDisplacement) {
+    size_t bandRows = options.streamBandRows;
+    size_t chunkLines = options.sortChunkLines;
+    string tmp = outputFile + ".stream";
+    // 各帶共用同一截止時間；視窗內的總位移不代表整體，進度改在每帶定案後依間隔輸出已寫出的累計位移
+    TimeBudget bandBudget = budget;
+    bandBudget.logInterval = 0.0;
+    double nextLog = budget.logInterval;
+
+    // 模組尺寸與位置各自依名稱外部排序
+    {
+        ofstream out(tmp + ".nodes");
+        out << setprecision(17);
+        forEachNode(files.at("nodes"), [&](const Node& node) {
+            out << node.name << '\t' << node.width << '\t' << node.height << '\t' << (node.isTerminal ? 1 : 0) << '\n';
+        });
+    }
+    {
+        ofstream out(tmp + ".pl");
+        out << setprecision(17);
+        forEachPosition(files.at("pl"), [&](const string& name, const Position& pos) {
+            out << name << '\t' << pos.x << '\t' << pos.y << '\n';
+        });
+    }
+    auto byLine = [](const string& a, const string& b) { return a < b; };
+    externalSort(tmp + ".nodes", tmp + ".nodes.sorted", chunkLines, byLine);
+    externalSort(tmp + ".pl", tmp + ".pl.sorted", chunkLines, byLine);
+    remove((tmp + ".nodes").c_str());
+    remove((tmp + ".pl").c_str());
+
+    // 依名稱合併：每行為 y x 名稱 寬 高 是否固定，找不到位置的模組放在原點
+    {
+        ifstream nodesIn(tmp + ".nodes.sorted");
+        ifstream plIn(tmp + ".pl.sorted");
+        ofstream out(tmp + ".joined");
+        string nodeLine, plLine;
+        bool hasPl = static_cast<bool>(getline(plIn, plLine));
+        while (getline(nodesIn, nodeLine)) {
+            string name = nodeLine.substr(0, nodeLine.find('\t'));
+            while (hasPl && plLine.substr(0, plLine.find('\t')) < name) {
+                hasPl = static_cast<bool>(getline(plIn, plLine));
+            }
+            string x = "0", y = "0";
+            if (hasPl && plLine.substr(0, plLine.find('\t')) == name) {
+                istringstream iss(plLine);
+                string plName;
+                iss >> plName >> x >> y;
+            }
+            out << y << '\t' << x << '\t' << nodeLine << '\n';
+        }
+    }
+    remove((tmp + ".nodes.sorted").c_str());
+    remove((tmp + ".pl.sorted").c_str());
+    externalSort(tmp + ".joined", tmp + ".sorted", chunkLines, [](const string& a, const string& b) {
+        char* endA;
+        char* endB;
+        double yA = strtod(a.c_str(), &endA);
+        double yB = strtod(b.c_str(), &endB);
+        if (yA != yB) return yA < yB;
+        return strtod(endA, nullptr) < strtod(endB, nullptr);
+    });
+    remove((tmp + ".joined").c_str());
+
+    // 行依Y排序，初始時不配置任何站點
+    stable_sort(placement.rows.begin(), placement.rows.end(), [](const Row& a, const Row& b) {
+        return a.yStart < b.yStart;
+    });
+    convertToSiteUnits(placement);
+
+    ifstream sortedIn(tmp + ".sorted");
+    // 讀入一筆模組並換算為定點站點座標，pos 保留讀入的原始座標供固定模組直接輸出
+    auto readRecord = [&](Block& block, Position& pos) {
+        string line;
+        if (!getline(sortedIn, line)) return false;
+        istringstream iss(line);
+        int terminal = 0;
+        double width = 0.0, height = 0.0;
+        iss >> pos.y >> pos.x >> block.name >> width >> height >> terminal;
+        block.isFixed = (terminal != 0);
+        convertBlockToSiteUnits(block, placement, pos.x, pos.y, width, height);
+        return true;
+    };
+
+    string plFilename = outputFile + ".pl" + compressionSuffix(options.compression);
+    OutputFile plOut(plFilename, options.compression);
+    if (!plOut) {
+        cerr << "無法寫入 .pl 檔案：" << plFilename << endl;
+        exit(1);
+    }
+    plOut << "UCLA pl 1.0\n\n";
+    plOut << fixed << setprecision(6); // 設置輸出精度
+
+    totalDisplacement = 0.0;
+    long long maxUnits = 0;
+    auto emit = [&](const Block& block) {
+        plOut << block.name << " " << blockX(placement, block) << " " << blockY(placement, block) << "\n";
+        long long displacement = blockDisplacement(placement, block);
+        totalDisplacement += fromSiteUnits(displacement, placement.siteWidth);
+        maxUnits = max(maxUnits, displacement);
+    };
+    // 輸出已定案行中的模組並釋放這些行
+    auto finalizeRows = [&](size_t begin, size_t end) {
+        vector<string> finished;
+        for (size_t r = begin; r < end; ++r) {
+            for (auto& subrow : placement.rows[r].subRows) {
+                for (Block* block : subrow.placedBlocks) {
+                    emit(*block);
+                    finished.push_back(block->name);
+                }
+            }
+            releaseRow(placement, r);
+        }
+        for (const auto& name : finished) {
+            placement.blocks.erase(name);
+        }
+    };
+
+    size_t numRows = placement.rows.size();
+    size_t numBands = (numRows + bandRows - 1) / bandRows;
+    size_t activeEnd = 0;
+    size_t peakResident = 0;
+    Block pending;
+    Position pendingPos;
+    bool hasPending = readRecord(pending, pendingPos);
+    for (size_t band = 0; band < numBands; ++band) {
+        // 視窗包含前一帶(尚未定案)、本帶與下一帶(供溢出使用)
+        size_t bandEnd = min(numRows, (band + 1) * bandRows);
+        size_t windowEnd = min(numRows, (band + 2) * bandRows);
+        for (; activeEnd < windowEnd; ++activeEnd) {
+            activateRow(placement, activeEnd);
+        }
+        placement.rowBegin = band > 0 ? (band - 1) * bandRows : 0;
+        placement.rowEnd = windowEnd;
+
+        // 讀入最近行落在本帶的模組，固定模組直接輸出
+        while (hasPending && (band + 1 == numBands || nearestRowIndex(placement, pending.origY) < bandEnd)) {
+            if (pending.isFixed) {
+                plOut << pending.name << " " << pendingPos.x << " " << pendingPos.y << "\n"; // 固定模組不移動
+            }
+            else if (placement.blocks.find(pending.name) != placement.blocks.end()) {
+                cerr << "警告：發現重複的模組名稱：" << pending.name << "，忽略後者。" << endl;
+            }
+            else {
+                placement.blocks[pending.name] = pending;
+            }
+            hasPending = readRecord(pending, pendingPos);
+        }
+        peakResident = max(peakResident, placement.blocks.size());
+
+        // 前幾帶放不下的模組仍留在記憶體中，視窗上移後於此重新嘗試
+        runInitialPlacement(placement, options);
+        optimizePlacement(placement, bandBudget);
+
+        if (band > 0) {
+            finalizeRows((band - 1) * bandRows, band * bandRows);
+        }
+        if (budget.logInterval > 0.0) {
+            double elapsed = budget.elapsed();
+            if (elapsed >= nextLog) {
+                cout << fixed << setprecision(4) << "[" << elapsed << "s] band " << band + 1 << "/" << numBands
+                    << " emitted displacement: " << totalDisplacement << endl;
+                nextLog = elapsed + budget.logInterval;
+            }
+        }
+    }
+    finalizeRows(placement.rowBegin, placement.rowEnd);
+    if (budget.logInterval > 0.0) {
+        cout << fixed << setprecision(4) << "[" << budget.elapsed() << "s] "
+            << (budget.expired() ? "time limit reached" : "stream finished") << " after band " << numBands
+            << ", total displacement: " << totalDisplacement << endl;
+    }
+    sortedIn.close();
+    if (!plOut.close()) {
+        cerr << "錯誤：寫入檔案失敗：" << plFilename << endl;
+        remove((tmp + ".sorted").c_str());
+        return false;
+    }
+    remove((tmp + ".sorted").c_str());
+
+    maxDisplacement = fromSiteUnits(maxUnits, placement.siteWidth);
+    cout << "Stream bands: " << numBands << ", peak resident cells: " << peakResident << endl;
+
+    // 最後一帶之後仍未放置的模組無法合法輸出
+    if (!placement.blocks.empty()) {
+        cerr << "錯誤：串流模式中有 " << placement.blocks.size() << " 個模組無法放置，例如 "
+            << placement.blocks.begin()->first << "。" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 平行處理 [0, n)：以固定大小的區塊動態分配給各執行緒，fn(begin, end, 執行緒編號)
+void parallelFor(size_t n, int numThreads, const function<void(size_t, size_t, int)>& fn) {
+    numThreads = max(1, numThreads);
+    size_t chunk = max<size_t>(1, n / (static_cast<size_t>(numThreads) * 16));
+    atomic<size_t> next(0);
+    auto worker = [&](int tid) {
+        for (;;) {
+            size_t begin = next.fetch_add(chunk);
+            if (begin >= n) break;
+            fn(begin, min(n, begin + chunk), tid);
+        }
+    };
+    vector<thread> threads;
+    for (int t = 1; t < numThreads; ++t) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// .nets讀檔：轉為 CSR 格式，第 i 條線網的接腳為 [netStart[i], netStart[i+1])
+void parseNetsFile(const string& filename, const unordered_map<string, int>& cellIndex, NetList& nets) {
+    InputFile infile(filename);
+    if (!infile) {
+        cerr << "無法打開 .nets 檔案：" << filename << endl;
+        exit(1);
+    }
+    nets.netStart.assign(1, 0);
+    nets.pinCell.clear();
+    nets.pinDx.clear();
+    nets.pinDy.clear();
+    string line;
+    size_t unknownPins = 0;
+    while (getline(infile, line)) {
+        string trimmedLine = trim(line);
+        if (trimmedLine.empty() || trimmedLine[0] == '#') continue;
+        istringstream iss(trimmedLine);
+        string first;
+        iss >> first;
+        if (first == "UCLA" || first == "NumNets" || first == "NumPins") continue;
+        if (first == "NetDegree") {
+            // 新線網：結束上一條
+            if (nets.netStart.back() != static_cast<int>(nets.pinCell.size())) {
+                nets.netStart.push_back(static_cast<int>(nets.pinCell.size()));
+            }
+            continue;
+        }
+        // 接腳行：名稱 方向 [: dx dy]
+        auto it = cellIndex.find(first);
+        if (it == cellIndex.end()) {
+            unknownPins++;
+            continue;
+        }
+        float dx = 0.0f, dy = 0.0f;
+        size_t colon = trimmedLine.find(':');
+        if (colon != string::npos) {
+            istringstream offsets(trimmedLine.substr(colon + 1));
+            offsets >> dx >> dy;
+        }
+        nets.pinCell.push_back(it->second);
+        nets.pinDx.push_back(dx);
+        nets.pinDy.push_back(dy);
+    }
+    if (nets.netStart.back() != static_cast<int>(nets.pinCell.size())) {
+        nets.netStart.push_back(static_cast<int>(nets.pinCell.size()));
+    }
+    if (unknownPins > 0) {
+        cerr << "警告：.nets 中有 " << unknownPins << " 個接腳對應不到模組，已忽略。" << endl;
+    }
+}
+
+// 半周長線長：接腳位置為模組中心加上偏移，依線網平行計算
+double computeHpwl(const NetList& nets, const vector<double>& centerX, const vector<double>& centerY, int numThreads) {
+    size_t numNets = nets.netStart.size() - 1;
+    vector<double> partial(max(1, numThreads), 0.0);
+    parallelFor(numNets, numThreads, [&](size_t begin, size_t end, int tid) {
+        double sum = 0.0;
+        for (size_t n = begin; n < end; ++n) {
+            int p = nets.netStart[n];
+            int pEnd = nets.netStart[n + 1];
+            if (pEnd - p < 2) continue;
+            double minX = numeric_limits<double>::infinity(), maxXPin = -minX;
+            double minY = minX, maxYPin = -minX;
+            for (; p < pEnd; ++p) {
+                double px = centerX[nets.pinCell[p]] + nets.pinDx[p];
+                double py = centerY[nets.pinCell[p]] + nets.pinDy[p];
+                minX = min(minX, px);
+                maxXPin = max(maxXPin, px);
+                minY = min(minY, py);
+                maxYPin = max(maxYPin, py);
+            }
+            sum += (maxXPin - minX) + (maxYPin - minY);
+        }
+        partial[tid] += sum;
+    });
+    return accumulate(partial.begin(), partial.end(), 0.0);
+}
+
+// 合法性檢查：每個可移動模組需對齊某一行與站點且落在子行內，
+// 再依行平行掃描(依X排序)找出與其他模組或固定模組重疊者
+LegalityReport checkLegality(const vector<Row>& rows, const vector<string>& names,
+    const vector<double>& widths, const vector<double>& heights, const vector<bool>& fixedCell,
+    const vector<double>& xs, const vector<double>& ys, const vector<bool>& present, int numThreads) {
+    LegalityReport report;
+    const double eps = 1e-6;
+    mutex exampleMutex;
+    auto addExample = [&](const string& message) {
+        lock_guard<mutex> lock(exampleMutex);
+        if (report.examples.size() < 10) {
+            report.examples.push_back(message);
+        }
+    };
+
+    vector<size_t> rowOrder(rows.size());
+    iota(rowOrder.begin(), rowOrder.end(), 0);
+    stable_sort(rowOrder.begin(), rowOrder.end(), [&](size_t a, size_t b) {
+        return rows[a].yStart < rows[b].yStart;
+    });
+    double maxRowHeight = 0.0;
+    for (const auto& row : rows) {
+        maxRowHeight = max(maxRowHeight, row.height);
+    }
+    auto firstRowAtOrAbove = [&](double y) {
+        return static_cast<size_t>(lower_bound(rowOrder.begin(), rowOrder.end(), y, [&](size_t r, double v) {
+            return rows[r].yStart < v;
+        }) - rowOrder.begin());
+    };
+
+    // 依所在行分組：可移動模組檢查對齊，固定模組放入所有與其相交的行
+    vector<vector<int>> movableInRow(rows.size());
+    vector<vector<int>> fixedInRow(rows.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!present[i]) {
+            if (!fixedCell[i]) {
+                report.missing++;
+                addExample("missing: " + names[i]);
+            }
+            continue;
+        }
+        if (fixedCell[i]) {
+            if (widths[i] <= 0.0 || heights[i] <= 0.0) continue;
+            for (size_t k = firstRowAtOrAbove(ys[i] - maxRowHeight); k < rowOrder.size(); ++k) {
+                const Row& row = rows[rowOrder[k]];
+                if (row.yStart >= ys[i] + heights[i] - eps) break;
+                if (row.yStart + row.height > ys[i] + eps) {
+                    fixedInRow[rowOrder[k]].push_back(static_cast<int>(i));
+                }
+            }
+            continue;
+        }
+        size_t k = firstRowAtOrAbove(ys[i] - eps);
+        if (k >= rowOrder.size() || abs(rows[rowOrder[k]].yStart - ys[i]) > eps) {
+            report.offRow++;
+            addExample("off row: " + names[i]);
+            continue;
+        }
+        size_t r = rowOrder[k];
+        const Row& row = rows[r];
+        if (heights[i] > row.height + eps) {
+            report.tooTall++;
+            addExample("taller than row: " + names[i]);
+        }
+        const SubRow* inside = nullptr;
+        for (const auto& subrow : row.subRows) {
+            if (xs[i] >= subrow.xStart - eps && xs[i] + widths[i] <= subrow.xEnd + eps) {
+                inside = &subrow;
+                break;
+            }
+        }
+        if (!inside) {
+            report.outsideSubrow++;
+            addExample("outside subrow: " + names[i]);
+        }
+        else {
+            double site = (xs[i] - inside->xStart) / inside->siteWidth;
+            if (abs(site - round(site)) > eps) {
+                report.offSite++;
+                addExample("off site: " + names[i]);
+            }
+        }
+        movableInRow[r].push_back(static_cast<int>(i));
+    }
+
+    // 依行平行掃描重疊
+    vector<size_t> overlaps(max(1, numThreads), 0), overTerminal(max(1, numThreads), 0);
+    parallelFor(rows.size(), numThreads, [&](size_t begin, size_t end, int tid) {
+        vector<int> cells;
+        for (size_t r = begin; r < end; ++r) {
+            cells = movableInRow[r];
+            cells.insert(cells.end(), fixedInRow[r].begin(), fixedInRow[r].end());
+            sort(cells.begin(), cells.end(), [&](int a, int b) {
+                return xs[a] < xs[b];
+            });
+            double movableEnd = -numeric_limits<double>::infinity();
+            double fixedEnd = movableEnd;
+            int lastMovable = -1, lastFixed = -1;
+            for (int c : cells) {
+                double cellEnd = xs[c] + widths[c];
+                if (!fixedCell[c]) {
+                    if (xs[c] < movableEnd - eps) {
+                        overlaps[tid]++;
+                        addExample("overlap: " + names[c] + " / " + names[lastMovable]);
+                    }
+                    if (xs[c] < fixedEnd - eps) {
+                        overTerminal[tid]++;
+                        addExample("over terminal: " + names[c] + " / " + names[lastFixed]);
+                    }
+                    if (cellEnd > movableEnd) {
+                        movableEnd = cellEnd;
+                        lastMovable = c;
+                    }
+                }
+                else {
+                    if (xs[c] < movableEnd - eps) {
+                        overTerminal[tid]++;
+                        addExample("over terminal: " + names[lastMovable] + " / " + names[c]);
+                    }
+                    if (cellEnd > fixedEnd) {
+                        fixedEnd = cellEnd;
+                        lastFixed = c;
+                    }
+                }
+            }
+        }
+    });
+    report.overlaps = accumulate(overlaps.begin(), overlaps.end(), size_t(0));
+    report.overTerminal = accumulate(overTerminal.begin(), overTerminal.end(), size_t(0));
+    return report;
+}
+
+// 讀入模組尺寸與行：模組依名稱排序後編號，所有資料以陣列存放(檢查與繪圖模式共用)
+void loadDesignArrays(const unordered_map<string, string>& files, DesignArrays& design) {
+    unordered_map<string, Node> nodes;
+    parseNodesFile(files.at("nodes"), nodes);
+    double maxX, maxY;
+    parseSclFile(files.at("scl"), design.rows, maxX, maxY);
+
+    size_t numCells = nodes.size();
+    design.names.clear();
+    design.names.reserve(numCells);
+    for (const auto& kv : nodes) {
+        design.names.push_back(kv.first);
+    }
+    sort(design.names.begin(), design.names.end());
+    design.cellIndex.clear();
+    design.widths.assign(numCells, 0.0);
+    design.heights.assign(numCells, 0.0);
+    design.fixedCell.assign(numCells, false);
+    for (size_t i = 0; i < numCells; ++i) {
+        const Node& node = nodes[design.names[i]];
+        design.cellIndex[design.names[i]] = static_cast<int>(i);
+        design.widths[i] = node.width;
+        design.heights[i] = node.height;
+        design.fixedCell[i] = node.isTerminal;
+    }
+}
+
+// 讀取位置(找不到位置的模組在原點，與合法化流程相同)
+void loadCellPositions(const string& filename, const DesignArrays& design,
+    vector<double>& xs, vector<double>& ys, vector<bool>& present) {
+    size_t numCells = design.names.size();
+    xs.assign(numCells, 0.0);
+    ys.assign(numCells, 0.0);
+    present.assign(numCells, false);
+    forEachPosition(filename, [&](const string& name, const Position& pos) {
+        auto it = design.cellIndex.find(name);
+        if (it == design.cellIndex.end()) return;
+        xs[it->second] = pos.x;
+        ys[it->second] = pos.y;
+        present[it->second] = true;
+    });
+}
+
+// 檢查模式：重新讀取輸出的 .pl(plFilename 為實際寫出的檔名，含壓縮副檔名)檢查合法性，並計算合法化前後的半周長線長
+bool runChecker(const unordered_map<string, string>& files, const string& plFilename, int numThreads) {
+    auto start = chrono::steady_clock::now();
+
+    DesignArrays design;
+    loadDesignArrays(files, design);
+    const vector<Row>& rows = design.rows;
+    const vector<string>& names = design.names;
+    const vector<double>& widths = design.widths;
+    const vector<double>& heights = design.heights;
+    const vector<bool>& fixedCell = design.fixedCell;
+    size_t numCells = names.size();
+    vector<double> beforeX, beforeY, afterX, afterY;
+    vector<bool> beforePresent, afterPresent;
+    loadCellPositions(files.at("pl"), design, beforeX, beforeY, beforePresent);
+    loadCellPositions(plFilename, design, afterX, afterY, afterPresent);
+
+    LegalityReport report = checkLegality(rows, names, widths, heights, fixedCell, afterX, afterY, afterPresent, numThreads);
+    size_t violations = report.overlaps + report.overTerminal + report.offRow + report.offSite +
+        report.outsideSubrow + report.tooTall + report.missing;
+
+    NetList nets;
+    parseNetsFile(files.at("nets"), design.cellIndex, nets);
+    auto centers = [&](const vector<double>& xs, const vector<double>& ys, vector<double>& cx, vector<double>& cy) {
+        cx.resize(numCells);
+        cy.resize(numCells);
+        for (size_t i = 0; i < numCells; ++i) {
+            cx[i] = xs[i] + widths[i] / 2.0;
+            cy[i] = ys[i] + heights[i] / 2.0;
+        }
+    };
+    vector<double> cx, cy;
+    centers(beforeX, beforeY, cx, cy);
+    double hpwlBefore = computeHpwl(nets, cx, cy, numThreads);
+    centers(afterX, afterY, cx, cy);
+    double hpwlAfter = computeHpwl(nets, cx, cy, numThreads);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << fixed << setprecision(4);
+    cout << "Legality check: " << (violations == 0 ? "PASS" : "FAIL") << " (" << numCells << " cells, "
+        << rows.size() << " rows, " << nets.netStart.size() - 1 << " nets, " << numThreads << " threads, "
+        << seconds << "s)" << endl;
+    cout << "  overlaps: " << report.overlaps << ", over terminals: " << report.overTerminal
+        << ", off row: " << report.offRow << ", off site: " << report.offSite
+        << ", outside subrow: " << report.outsideSubrow << ", too tall: " << report.tooTall
+        << ", missing: " << report.missing << endl;
+    for (const auto& example : report.examples) {
+        cerr << "  " << example << endl;
+    }
+    cout << "HPWL before: " << hpwlBefore << endl;
+    cout << "HPWL after: " << hpwlAfter;
+    if (hpwlBefore > 0.0) {
+        cout << " (" << showpos << (hpwlAfter - hpwlBefore) / hpwlBefore * 100.0 << noshowpos << "%)";
+    }
+    cout << endl;
+    return violations == 0;
+}
+
+//繪圖視窗：設計座標與影像像素的對應(影像的Y軸向下)
+const double maxRenderPixels = 268435456.0;   //整張影像的像素上限(2^28，如 16384 x 16384)
+const double maxTilePixels = 67108864.0;      //單一圖塊的像素上限(2^26，如 8192 x 8192)
+
+struct RenderView {
+    double x0, y0, x1, y1;   //設計座標範圍
+    double scale;            //每單位的像素數
+    int width;               //影像寬度(像素)
+    int height;              //影像高度(像素)
+
+    //縮放後的座標(像素單位，Y軸向上)
+    double scaledX(double x) const { return (x - x0) * scale; }
+    double scaledY(double y) const { return (y - y0) * scale; }
+
+    //轉成整數前夾在 ±1e9 內：縮放範圍很小時遠處的座標會超出 int
+    static int clampPixel(double v) { return static_cast<int>(min(max(v, -1e9), 1e9)); }
+
+    //矩形 [x, x+w) × [y, y+h) 涵蓋的像素範圍 [px0, px1) × [py0, py1)，至少一個像素
+    void pixelRect(double x, double y, double w, double h, int& px0, int& py0, int& px1, int& py1) const {
+        px0 = clampPixel(floor(scaledX(x)));
+        px1 = max(px0 + 1, clampPixel(ceil(scaledX(x + w))));
+        py1 = height - clampPixel(floor(scaledY(y)));
+        py0 = min(py1 - 1, height - clampPixel(ceil(scaledY(y + h))));
+    }
+    int pixelX(double x) const { return clampPixel(floor(scaledX(x))); }
+    int pixelY(double y) const { return height - 1 - clampPixel(floor(scaledY(y))); }
+};
+
+// Liang-Barsky 裁切：線段 (ax, ay) + t·(dx, dy), t ∈ [0, 1] 落在矩形 [xlo, xhi] × [ylo, yhi] 內的參數範圍 [t0, t1]
+// 完全在外回傳 false
+inline bool clipSegment(double ax, double ay, double dx, double dy, double xlo, double ylo, double xhi, double yhi,
+    double& t0, double& t1) {
+    double p[4] = { -dx, dx, -dy, dy };
+    double q[4] = { ax - xlo, xhi - ax, ay - ylo, yhi - ay };
+    t0 = 0.0;
+    t1 = 1.0;
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.0) {
+            if (q[k] < 0.0) return false; // 平行於此邊且在外側
+        }
+        else if (p[k] < 0.0) {
+            t0 = max(t0, q[k] / p[k]);
+        }
+        else {
+            t1 = min(t1, q[k] / p[k]);
+        }
+    }
+    return t0 <= t1;
+}
+
+// 位移熱度色階：0 為藍色，1 為紅色
+inline void heatColor(double t, unsigned char rgb[3]) {
+    t = min(max(t, 0.0), 1.0);
+    auto channel = [](double v) {
+        return static_cast<unsigned char>(255.0 * min(max(v, 0.0), 1.0));
+    };
+    rgb[0] = channel(1.5 - abs(4.0 * t - 3.0));
+    rgb[1] = channel(1.5 - abs(4.0 * t - 2.0));
+    rgb[2] = channel(1.5 - abs(4.0 * t - 1.0));
+}
+
+// 輸出二進位 PPM 影像
+void writePpmFile(const string& filename, int width, int height, const vector<unsigned char>& pixels) {
+    ofstream outfile(filename, ios::binary);
+    if (!outfile) {
+        cerr << "無法寫入影像檔案：" << filename << endl;
+        exit(1);
+    }
+    outfile << "P6\n" << width << " " << height << "\n255\n";
+    outfile.write(reinterpret_cast<const char*>(pixels.data()), static_cast<streamsize>(pixels.size()));
+}
+
+// 繪圖模式：讀取合法化前後的位置，以多執行緒逐圖塊繪製成 PPM
+// before 圖層為原始位置，after 圖層以位移熱度著色並畫出位移向量
+bool runRenderer(const unordered_map<string, string>& files, const string& outputFile, const string& plFilename,
+    const Options& options) {
+    auto start = chrono::steady_clock::now();
+
+    DesignArrays design;
+    loadDesignArrays(files, design);
+    size_t numCells = design.names.size();
+    vector<double> beforeX, beforeY, afterX, afterY;
+    vector<bool> beforePresent, afterPresent;
+    loadCellPositions(files.at("pl"), design, beforeX, beforeY, beforePresent);
+    loadCellPositions(plFilename, design, afterX, afterY, afterPresent);
+
+    // 位移(只計可移動模組)
+    vector<double> displacement(numCells, 0.0);
+    double maxDisplacement = 0.0;
+    for (size_t i = 0; i < numCells; ++i) {
+        if (!design.fixedCell[i] && afterPresent[i]) {
+            displacement[i] = abs(afterX[i] - beforeX[i]) + abs(afterY[i] - beforeY[i]);
+            maxDisplacement = max(maxDisplacement, displacement[i]);
+        }
+    }
+
+    // 視窗：指定的縮放範圍，或行與所有模組的外框
+    RenderView view;
+    if (options.zoom) {
+        view.x0 = options.zoomX0;
+        view.y0 = options.zoomY0;
+        view.x1 = options.zoomX1;
+        view.y1 = options.zoomY1;
+    }
+    else {
+        view.x0 = view.y0 = numeric_limits<double>::infinity();
+        view.x1 = view.y1 = -numeric_limits<double>::infinity();
+        auto extend = [&](double x, double y, double w, double h) {
+            view.x0 = min(view.x0, x);
+            view.y0 = min(view.y0, y);
+            view.x1 = max(view.x1, x + w);
+            view.y1 = max(view.y1, y + h);
+        };
+        for (const auto& row : design.rows) {
+            for (const auto& subrow : row.subRows) {
+                extend(subrow.xStart, row.yStart, subrow.xEnd - subrow.xStart, row.height);
+            }
+        }
+        for (size_t i = 0; i < numCells; ++i) {
+            if (beforePresent[i]) extend(beforeX[i], beforeY[i], design.widths[i], design.heights[i]);
+            if (afterPresent[i]) extend(afterX[i], afterY[i], design.widths[i], design.heights[i]);
+        }
+    }
+    if (!(view.x1 > view.x0) || !(view.y1 > view.y0)) {
+        cerr << "錯誤：繪圖範圍無效。" << endl;
+        return false;
+    }
+    view.scale = options.renderWidth / (view.x1 - view.x0);
+    view.width = options.renderWidth;
+    // 高度先以 double 計算，過扁或過高的視窗不可溢位成錯誤的尺寸
+    double height = max(1.0, ceil((view.y1 - view.y0) * view.scale));
+    if (!(height <= numeric_limits<int>::max()) || view.width * height > maxRenderPixels) {
+        cerr << "錯誤：影像過大(" << view.width << " x " << fixed << setprecision(0) << height << " 像素，上限 "
+            << static_cast<long long>(maxRenderPixels) << " 像素)，請調整 --render-width 或 --zoom。" << endl;
+        return false;
+    }
+    view.height = static_cast<int>(height);
+
+    // 每個執行緒各配置一個圖塊緩衝區，以實際圖塊尺寸檢查
+    int tileSize = options.tileSize;
+    if (static_cast<double>(min(tileSize, view.width)) * min(tileSize, view.height) > maxTilePixels) {
+        cerr << "錯誤：圖塊過大(邊長 " << tileSize << " 像素，每塊上限 "
+            << static_cast<long long>(maxTilePixels) << " 像素)，請調整 --tile。" << endl;
+        return false;
+    }
+    int tilesX = (view.width + tileSize - 1) / tileSize;
+    int tilesY = (view.height + tileSize - 1) / tileSize;
+    size_t numTiles = static_cast<size_t>(tilesX) * tilesY;
+
+    // 將模組與位移向量分到涵蓋的圖塊
+    auto binRect = [&](int px0, int py0, int px1, int py1, int item, vector<vector<int>>& bins) {
+        px0 = max(px0, 0);
+        py0 = max(py0, 0);
+        px1 = min(px1, view.width);
+        py1 = min(py1, view.height);
+        if (px0 >= px1 || py0 >= py1) return;
+        for (int ty = py0 / tileSize; ty <= (py1 - 1) / tileSize; ++ty) {
+            for (int tx = px0 / tileSize; tx <= (px1 - 1) / tileSize; ++tx) {
+                bins[static_cast<size_t>(ty) * tilesX + tx].push_back(item);
+            }
+        }
+    };
+    vector<vector<int>> beforeBins(numTiles), afterBins(numTiles), vectorBins(numTiles);
+    for (size_t i = 0; i < numCells; ++i) {
+        int px0, py0, px1, py1;
+        int item = static_cast<int>(i);
+        if (beforePresent[i]) {
+            view.pixelRect(beforeX[i], beforeY[i], design.widths[i], design.heights[i], px0, py0, px1, py1);
+            binRect(px0, py0, px1, py1, item, beforeBins);
+        }
+        if (afterPresent[i]) {
+            view.pixelRect(afterX[i], afterY[i], design.widths[i], design.heights[i], px0, py0, px1, py1);
+            binRect(px0, py0, px1, py1, item, afterBins);
+        }
+        if (displacement[i] > 0.0 && beforePresent[i]) {
+            int ax = view.pixelX(beforeX[i] + design.widths[i] / 2.0), ay = view.pixelY(beforeY[i] + design.heights[i] / 2.0);
+            int bx = view.pixelX(afterX[i] + design.widths[i] / 2.0), by = view.pixelY(afterY[i] + design.heights[i] / 2.0);
+            binRect(min(ax, bx), min(ay, by), max(ax, bx) + 1, max(ay, by) + 1, item, vectorBins);
+        }
+    }
+
+    // 逐圖塊平行繪製，每個工作為(圖層, 圖塊)
+    const unsigned char rowColor[3] = { 235, 235, 235 };
+    const unsigned char movableColor[3] = { 70, 130, 180 };
+    const unsigned char fixedColor[3] = { 90, 90, 90 };
+    const unsigned char vectorColor[3] = { 0, 0, 0 };
+    parallelFor(numTiles * 2, options.threads, [&](size_t begin, size_t end, int) {
+        vector<unsigned char> pixels;
+        for (size_t task = begin; task < end; ++task) {
+            bool after = task >= numTiles;
+            size_t tile = task % numTiles;
+            int tileX0 = static_cast<int>(tile % tilesX) * tileSize;
+            int tileY0 = static_cast<int>(tile / tilesX) * tileSize;
+            int tileW = min(tileSize, view.width - tileX0);
+            int tileH = min(tileSize, view.height - tileY0);
+            pixels.assign(static_cast<size_t>(tileW) * tileH * 3, 255);
+
+            auto fill = [&](int px0, int py0, int px1, int py1, const unsigned char rgb[3]) {
+                px0 = max(px0, tileX0);
+                py0 = max(py0, tileY0);
+                px1 = min(px1, tileX0 + tileW);
+                py1 = min(py1, tileY0 + tileH);
+                for (int py = py0; py < py1; ++py) {
+                    unsigned char* p = &pixels[(static_cast<size_t>(py - tileY0) * tileW + (px0 - tileX0)) * 3];
+                    for (int px = px0; px < px1; ++px, p += 3) {
+                        p[0] = rgb[0];
+                        p[1] = rgb[1];
+                        p[2] = rgb[2];
+                    }
+                }
+            };
+
+            for (const auto& row : design.rows) {
+                for (const auto& subrow : row.subRows) {
+                    int px0, py0, px1, py1;
+                    view.pixelRect(subrow.xStart, row.yStart, subrow.xEnd - subrow.xStart, row.height, px0, py0, px1, py1);
+                    fill(px0, py0, px1, py1, rowColor);
+                }
+            }
+
+            const vector<double>& xs = after ? afterX : beforeX;
+            const vector<double>& ys = after ? afterY : beforeY;
+            for (int i : (after ? afterBins : beforeBins)[tile]) {
+                int px0, py0, px1, py1;
+                view.pixelRect(xs[i], ys[i], design.widths[i], design.heights[i], px0, py0, px1, py1);
+                unsigned char heat[3];
+                const unsigned char* color = movableColor;
+                if (design.fixedCell[i]) {
+                    color = fixedColor;
+                }
+                else if (after) {
+                    heatColor(maxDisplacement > 0.0 ? displacement[i] / maxDisplacement : 0.0, heat);
+                    color = heat;
+                }
+                fill(px0, py0, px1, py1, color);
+            }
+
+            // 位移向量：端點取整後沿主軸每步一個像素、副軸四捨五入(第 k 步的像素只由 k 決定)
+            // 先以圖塊(各邊多留一個像素)裁出步數範圍，只走圖塊內的部分，跨圖塊的線段在接縫處一致
+            if (after) {
+                double clipX0 = tileX0 - 1.0, clipX1 = tileX0 + tileW + 1.0;
+                double clipY0 = view.height - tileY0 - tileH - 1.0, clipY1 = view.height - tileY0 + 1.0;
+                for (int i : vectorBins[tile]) {
+                    // 縮放後座標(Y軸向上)，以 double 計算不會溢位
+                    double ax = floor(view.scaledX(beforeX[i] + design.widths[i] / 2.0));
+                    double ay = floor(view.scaledY(beforeY[i] + design.heights[i] / 2.0));
+                    double dx = floor(view.scaledX(afterX[i] + design.widths[i] / 2.0)) - ax;
+                    double dy = floor(view.scaledY(afterY[i] + design.heights[i] / 2.0)) - ay;
+                    double t0, t1;
+                    if (!clipSegment(ax, ay, dx, dy, clipX0, clipY0, clipX1, clipY1, t0, t1)) {
+                        continue;
+                    }
+                    double steps = max(abs(dx), abs(dy));
+                    double kEnd = floor(t1 * steps);
+                    for (double k = ceil(t0 * steps); k <= kEnd; k += 1.0) {
+                        double t = steps > 0.0 ? k / steps : 0.0;
+                        int x = static_cast<int>(floor(ax + t * dx + 0.5));
+                        int y = view.height - 1 - static_cast<int>(floor(ay + t * dy + 0.5));
+                        fill(x, y, x + 1, y + 1, vectorColor);
+                    }
+                }
+            }
+
+            string filename = outputFile + (after ? ".after." : ".before.") +
+                to_string(tile / tilesX) + "_" + to_string(tile % tilesX) + ".ppm";
+            writePpmFile(filename, tileW, tileH, pixels);
+        }
+    });
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << fixed << setprecision(4);
+    cout << "Rendered " << view.width << "x" << view.height << " pixels as " << tilesY << "x" << tilesX
+        << " tiles per layer (" << outputFile << ".{before,after}.<row>_<col>.ppm), window ("
+        << view.x0 << ", " << view.y0 << ") - (" << view.x1 << ", " << view.y1 << "), max displacement "
+        << maxDisplacement << ", " << options.threads << " threads, " << seconds << "s" << endl;
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 解析整數選項值：整個字串須為介於 minValue 與型別上限之間的整數，否則輸出錯誤並回傳 false
+template <class T>
+bool parseIntOption(const string& name, const string& text, long long minValue, T& value) {
+    size_t pos = 0;
+    long long parsed = 0;
+    try {
+        parsed = stoll(text, &pos);
+    }
+    catch (const exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != text.size() || parsed < minValue ||
+        static_cast<unsigned long long>(parsed) > static_cast<unsigned long long>(numeric_limits<T>::max())) {
+        cerr << "錯誤：選項 " << name << " 需要不小於 " << minValue << " 的整數，收到：" << text << endl;
+        return false;
+    }
+    value = static_cast<T>(parsed);
+    return true;
+}
+
+// 解析實數選項值：整個字串須為不小於 minValue 的有限實數，否則輸出錯誤並回傳 false
+bool parseDoubleOption(const string& name, const string& text, double minValue, double& value) {
+    size_t pos = 0;
+    double parsed = 0.0;
+    try {
+        parsed = stod(text, &pos);
+    }
+    catch (const exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != text.size() || !isfinite(parsed) || parsed < minValue) {
+        cerr << "錯誤：選項 " << name << " 需要";
+        if (minValue > numeric_limits<double>::lowest()) {
+            cerr << "不小於 " << minValue << " 的";
+        }
+        cerr << "有限實數，收到：" << text << endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
+    TimeBudget budget; // 從程式啟動開始計時
+
     //檢查
-    if (argc != 3) {
-        cerr << "使用方式: " << argv[0] << " <input_file_prefix> <output_file_prefix>" << endl;
+    if (argc < 3) {
+        cerr << "使用方式: " << argv[0] << " <input_file_prefix> <output_file_prefix>"
+            << " [--stream <rows_per_band>] [--sort-chunk <lines>]"
+            << " [--time-limit <seconds>] [--log-interval <seconds>]"
+            << " [--engine <firstfit|sweep>] [--sweep-rows <k>]"
+            << " [--check] [--check-only] [--threads <n>]"
+            << " [--render] [--render-width <pixels>] [--tile <pixels>] [--zoom <x0> <y0> <x1> <y1>]"
+            << " [--compress <none|gzip|zstd>] [--multilevel <levels>]" << endl;
         return 1;
     }
 
     string inputFile = argv[1];  // 第一個引數是輸入檔案前綴
     string outputFile = argv[2]; // 第二個引數是輸出檔案前綴
 
+    // 解析選項
+    Options options;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        // 先比對選項名稱，再檢查其後是否還有足夠的數值
+        auto hasValues = [&](int count) {
+            if (i + count < argc) return true;
+            cerr << "錯誤：選項 " << arg << " 缺少數值(需要 " << count << " 個)。" << endl;
+            return false;
+        };
+        if (arg == "--stream") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.streamBandRows)) return 1;
+        }
+        else if (arg == "--sort-chunk") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.sortChunkLines)) return 1;
+        }
+        else if (arg == "--time-limit") {
+            if (!hasValues(1)) return 1;
+            if (!parseDoubleOption(arg, argv[++i], 0.0, options.timeLimit)) return 1;
+        }
+        else if (arg == "--log-interval") {
+            if (!hasValues(1)) return 1;
+            if (!parseDoubleOption(arg, argv[++i], 0.0, options.logInterval)) return 1;
+        }
+        else if (arg == "--engine") {
+            if (!hasValues(1)) return 1;
+            string engine = argv[++i];
+            if (engine == "sweep") {
+                options.engine = PlacementEngine::Sweep;
+            }
+            else if (engine == "firstfit") {
+                options.engine = PlacementEngine::FirstFit;
+            }
+            else {
+                cerr << "錯誤：未知的引擎：" << engine << endl;
+                return 1;
+            }
+            options.reportEngine = true;
+        }
+        else if (arg == "--sweep-rows") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.sweepRows)) return 1;
+        }
+        else if (arg == "--check") {
+            options.check = true;
+        }
+        else if (arg == "--check-only") {
+            options.checkOnly = true;
+        }
+        else if (arg == "--threads") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.threads)) return 1;
+        }
+        else if (arg == "--render") {
+            options.render = true;
+        }
+        else if (arg == "--render-width") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.renderWidth)) return 1;
+        }
+        else if (arg == "--tile") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.tileSize)) return 1;
+        }
+        else if (arg == "--zoom") {
+            if (!hasValues(4)) return 1;
+            options.zoom = true;
+            double lowest = numeric_limits<double>::lowest();
+            if (!parseDoubleOption(arg, argv[++i], lowest, options.zoomX0) ||
+                !parseDoubleOption(arg, argv[++i], lowest, options.zoomY0) ||
+                !parseDoubleOption(arg, argv[++i], lowest, options.zoomX1) ||
+                !parseDoubleOption(arg, argv[++i], lowest, options.zoomY1)) {
+                return 1;
+            }
+        }
+        else if (arg == "--compress") {
+            if (!hasValues(1)) return 1;
+            string format = argv[++i];
+            if (format == "none") {
+                options.compression = Compression::None;
+            }
+            else if (format == "gzip") {
+#ifdef USE_ZLIB
+                options.compression = Compression::Gzip;
+#else
+                cerr << "錯誤：未啟用 gzip，請以 -DUSE_ZLIB -lz 重新編譯。" << endl;
+                return 1;
+#endif
+            }
+            else if (format == "zstd") {
+#ifdef USE_ZSTD
+                options.compression = Compression::Zstd;
+#else
+                cerr << "錯誤：未啟用 zstd，請以 -DUSE_ZSTD -lzstd 重新編譯。" << endl;
+                return 1;
+#endif
+            }
+            else {
+                cerr << "錯誤：未知的壓縮格式：" << format << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--multilevel") {
+            if (!hasValues(1)) return 1;
+            if (!parseIntOption(arg, argv[++i], 1, options.multilevel)) return 1;
+        }
+        else {
+            cerr << "錯誤：無法識別的選項：" << arg << endl;
+            return 1;
+        }
+    }
+
+    budget.limit = options.timeLimit;
+    budget.logInterval = options.logInterval >= 0.0 ? options.logInterval : (options.timeLimit > 0.0 ? 1.0 : 0.0);
+
     //輸出執行命令
-    cout << "%> " << argv[0] << " " << argv[1] << " " << argv[2] << endl;
+    cout << "%>";
+    for (int i = 0; i < argc; ++i) {
+        cout << " " << argv[i];
+    }
+    cout << endl;
 
     string auxFile = inputFile + ".aux"; //.aux檔案名稱
     unordered_map<string, string> files;
@@ -819,6 +3385,45 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // 輸出檔案的壓縮副檔名(.aux 本身不壓縮)，檢查與繪圖讀取的正是這個 .pl
+    string suffix = compressionSuffix(options.compression);
+    string plFilename = outputFile + ".pl" + suffix;
+
+    // 檢查模式：只檢查既有的輸出
+    if (options.checkOnly) {
+        return runChecker(files, plFilename, options.threads) ? 0 : 2;
+    }
+    // 繪圖模式：只繪製既有的輸出
+    if (options.render) {
+        return runRenderer(files, outputFile, plFilename, options) ? 0 : 1;
+    }
+
+    // 串流模式：不將整個設計載入記憶體
+    if (options.streamBandRows > 0) {
+        Placement placement;
+        parseSclFile(files["scl"], placement.rows, placement.maxX, placement.maxY);
+        double totalDisplacement = 0.0;
+        double maxDisplacement = 0.0;
+        if (!streamLegalize(files, outputFile, placement, options, budget, totalDisplacement, maxDisplacement)) {
+            remove(plFilename.c_str()); // 不留下不合法的輸出
+            return 1;
+        }
+
+        cout << fixed << setprecision(4);
+        cout << "Total displacement: " << totalDisplacement << endl;
+        cout << "Maximum displacement: " << maxDisplacement << endl;
+
+        writeAuxFile(outputFile + ".aux", outputFile, suffix);
+        copyFile(files["nodes"], outputFile + ".nodes" + suffix, options.compression);
+        writeSclFile(outputFile + ".scl" + suffix, placement.rows, options.compression);
+        copyFile(files["nets"], outputFile + ".nets" + suffix, options.compression);
+        copyFile(files["wts"], outputFile + ".wts" + suffix, options.compression);
+        if (options.check && !runChecker(files, plFilename, options.threads)) {
+            return 2;
+        }
+        return 0;
+    }
+
     unordered_map<string, Node> nodes;
     parseNodesFile(files["nodes"], nodes);
 
@@ -835,42 +3440,53 @@ int main(int argc, char* argv[]) {
     double maxX, maxY;
     parseSclFile(files["scl"], rows, maxX, maxY);
 
-    // 初始化佈局
+    // 初始化佈局：行先轉換為定點站點座標，模組再依此換算
     Placement placement;
+    placement.rows = move(rows);
+    placement.maxX = maxX;
+    placement.maxY = maxY;
+    convertToSiteUnits(placement);
     for (const auto& kv : nodes) {
         Block block;
         block.name = kv.first;
-        block.width = kv.second.width;
-        block.height = kv.second.height;
         block.isFixed = kv.second.isTerminal;
+        Position pos = { 0.0, 0.0 }; // 如果未找到位置則放置在原點
         auto it = positions.find(kv.first);
         if (it != positions.end()) {
-            block.origX = it->second.x;
-            block.origY = it->second.y;
-            block.x = it->second.x;
-            block.y = it->second.y;
+            pos = it->second;
             // 增加除錯輸出
-            //cout << "模組 " << block.name << " 原始位置: (" << block.origX << ", " << block.origY << ")\n";
+            //cout << "模組 " << block.name << " 原始位置: (" << pos.x << ", " << pos.y << ")\n";
         }
-        else {
-            // 如果未找到位置則放置在原點
-            block.origX = 0.0;
-            block.origY = 0.0;
-            block.x = 0.0;
-            block.y = 0.0;
-            // 增加除錯輸出
-            //cout << "模組 " << block.name << " 未找到原始位置，設置為原點。\n";
+        convertBlockToSiteUnits(block, placement, pos.x, pos.y, kv.second.width, kv.second.height);
+        if (block.isFixed) {
+            placement.fixedPositions[kv.first] = pos;
         }
         placement.blocks[kv.first] = block;
     }
-    placement.rows = rows;
-    placement.maxX = maxX;
-    placement.maxY = maxY;
+    // 配置所有行的站點狀態
+    for (size_t r = 0; r < placement.rows.size(); ++r) {
+        activateRow(placement, r);
+    }
 
-    // 初始擺放
-    initialPlacement(placement);
-    // 二次優化
-    optimizePlacement(placement);
+    if (options.multilevel > 0) {
+        // 多層級合法化(取代下方的初始擺放與整體優化)
+        multilevelPlacement(placement, options, budget);
+    }
+    else {
+        // 初始擺放
+        double initialStart = budget.elapsed();
+        runInitialPlacement(placement, options);
+        if (options.reportEngine) {
+            double maxDisplacementInit = 0.0;
+            double totalDisplacementInit = calculateTotalDisplacement(placement, maxDisplacementInit);
+            cout << fixed << setprecision(4);
+            cout << "Initial placement (" << (options.engine == PlacementEngine::Sweep ? "sweep" : "firstfit") << "): "
+                << budget.elapsed() - initialStart << "s, total displacement: " << totalDisplacementInit
+                << ", maximum displacement: " << maxDisplacementInit << endl;
+        }
+        // 二次優化(在時間預算內)
+        optimizePlacement(placement, budget);
+    }
 
     // 計算總移動距離和最大移動距離
     double maxDisplacementOpt = 0.0;
@@ -882,15 +3498,18 @@ int main(int argc, char* argv[]) {
     cout << "Maximum displacement: " << maxDisplacementOpt << endl;
 
     // 寫入輸出檔案
-    writeAuxFile(outputFile + ".aux", outputFile);
-    writeNodesFile(outputFile + ".nodes", nodes);
-    writePlFile(outputFile + ".pl", placement);
-    writeSclFile(outputFile + ".scl", rows);
+    writeAuxFile(outputFile + ".aux", outputFile, suffix);
+    writeNodesFile(outputFile + ".nodes" + suffix, nodes, options.compression);
+    writePlFile(plFilename, placement, options.compression);
+    writeSclFile(outputFile + ".scl" + suffix, placement.rows, options.compression);
     // 複製 .nets 和 .wts 檔案
-    copyFile(files["nets"], outputFile + ".nets");
-    copyFile(files["wts"], outputFile + ".wts");
+    copyFile(files["nets"], outputFile + ".nets" + suffix, options.compression);
+    copyFile(files["wts"], outputFile + ".wts" + suffix, options.compression);
 
-    // 除錯輸出: 檢查模組位置
+    // 檢查輸出的合法性與線長
+    if (options.check && !runChecker(files, plFilename, options.threads)) {
+        return 2;
+    }
 
     return 0;
 }